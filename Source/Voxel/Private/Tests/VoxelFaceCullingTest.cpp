@@ -0,0 +1,114 @@
+#include "Misc/AutomationTest.h"
+#include "VoxelFaceCulling.h"
+#include "VoxelBlockRegistry.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVoxelFaceCullingTest, "Voxel.FaceCulling.MatchesReference", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+//Bitmask kernel and uniform chunk culling against the per voxel culling of the old mesher, on random volumes made of registered blocks
+bool FVoxelFaceCullingTest::RunTest(const FString& Parameters)
+{
+	const int NumIterations = 16;
+
+	//Block properties live as long as the registry is referenced
+	TSharedPtr<FBlockRegistryInstance> Registry = FBlockRegistry::GetInstance();
+
+	TArray<uint32> BlockIds;
+	for (uint32 Id = 0; Registry->IsValidIndex(Id); Id++)
+	{
+		if (Registry->GetBlockByIndex(Id))
+		{
+			BlockIds.Add(Id);
+		}
+	}
+
+	FRandomStream Random(314159);
+
+	FVoxelPaddedVolume Volume;
+
+	//Render and collision
+	TUniquePtr<FVoxelFaceMasks> Masks[2] = { MakeUnique<FVoxelFaceMasks>(), MakeUnique<FVoxelFaceMasks>() };
+	TUniquePtr<FVoxelFaceMasks> ReferenceMasks = MakeUnique<FVoxelFaceMasks>();
+
+	for (int Iteration = 0; Iteration < NumIterations; Iteration++)
+	{
+		//Sparse to dense volumes, first one is all empty
+		const float NonEmptyChance = static_cast<float>(Iteration) / FMath::Max(NumIterations - 1, 1);
+
+		for (uint32& BlockId : Volume.BlockIds)
+		{
+			BlockId = Random.FRand() < NonEmptyChance ? BlockIds[Random.RandHelper(BlockIds.Num())] : 0;
+		}
+
+		//Second half has chunk part made of one block, as uniform chunks are meshed
+		const bool bIsUniform = Iteration >= NumIterations / 2;
+
+		//Every other one as meshed without bOcculdeFaceBorder
+		Volume.bBorderOccludes = Iteration % 2 == 0;
+
+		if (bIsUniform)
+		{
+			const uint32 UniformId = BlockIds[Random.RandHelper(BlockIds.Num())];
+
+			for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
+			{
+				for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+				{
+					for (int X = 0; X < VOX_CHUNKSIZE; X++)
+					{
+						Volume.BlockIds[FVoxelPaddedVolume::GetIndex(X, Y, Z)] = UniformId;
+					}
+				}
+			}
+
+			FVoxelFaceCulling::BuildUniformFaceMasks(Volume, Masks[0].Get(), Masks[1].Get());
+		}
+		else
+		{
+			//Combined pass, same as building each alone
+			FVoxelFaceCulling::BuildFaceMasks(Volume, *Masks[0], *Masks[1]);
+		}
+
+		for (const bool bCollision : { false, true })
+		{
+			const FVoxelFaceMasks& BuiltMasks = *Masks[bCollision];
+
+			if (bCollision)
+			{
+				FVoxelFaceCulling::BuildCollisionFaceMasksReference(Volume, *ReferenceMasks);
+			}
+			else
+			{
+				FVoxelFaceCulling::BuildRenderFaceMasksReference(Volume, *ReferenceMasks);
+			}
+
+			TestTrue(FString::Printf(TEXT("Iteration %d, uniform %d, border occludes %d, collision %d : %d faces, reference %d faces"),
+				Iteration, bIsUniform, Volume.bBorderOccludes, bCollision, BuiltMasks.CountFaces(), ReferenceMasks->CountFaces()), BuiltMasks == *ReferenceMasks);
+		}
+	}
+
+	//Without bOcculdeFaceBorder, a full chunk shows its whole outside even if the border is the same block
+	for (const uint32 BlockId : BlockIds)
+	{
+		if (!GetVoxelBlockProperties(BlockId).bPolygonize)
+		{
+			continue;
+		}
+
+		for (uint32& VolumeId : Volume.BlockIds)
+		{
+			VolumeId = BlockId;
+		}
+		Volume.bBorderOccludes = false;
+
+		FVoxelFaceCulling::BuildRenderFaceMasks(Volume, *Masks[0]);
+
+		TestEqual(TEXT("Border faces of full chunk, border doesn't occlude"), Masks[0]->CountFaces(), 6 * VOX_CHUNKSIZE * VOX_CHUNKSIZE);
+		break;
+	}
+
+	return true;
+}
+
+#endif
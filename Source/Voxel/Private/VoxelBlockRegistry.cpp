@@ -120,6 +120,8 @@ void FBlockRegistryInstance::Setup()
 
 	checkf(UniqueIndices[0]->GetClass() == UDefaultBlockEmpty::StaticClass(), TEXT("Index 0 must be UDefaultBlockEmpty"));
 
+	BuildBlockProperties();
+
 	bIsInitialized = true;
 
 	UE_LOG(LogVoxel, Warning, TEXT("Registered %d voxel blocks"), BlockInstanceRegistry.Num());
@@ -139,12 +141,55 @@ void FBlockRegistryInstance::Reset()
 	}
 
 	UniqueIndices.Empty();
+	BlockProperties.Empty();
+	NumSectionKeys = 0;
 
 	bIsInitialized = false;
 
 	UE_LOG(LogVoxel, Warning, TEXT("Block registry is destroyed"));
 }
 
+void FBlockRegistryInstance::BuildBlockProperties()
+{
+	BlockProperties.Reset();
+	BlockProperties.AddDefaulted(UniqueIndices.Num());
+
+	//Blocks with same material share a section unless bSeparateMeshSections
+	TMap<UMaterialInterface*, int32> MaterialSectionKeys;
+	NumSectionKeys = 0;
+
+	for (int Index = 0; Index < UniqueIndices.Num(); Index++)
+	{
+		UVoxelBlockDef* Block = UniqueIndices[Index];
+
+		//Unused index, stays as empty block
+		if (!Block) continue;
+
+		FVoxelBlockProperties& Properties = BlockProperties[Index];
+
+		Properties.DefaultColor = Block->DefaultColor;
+		Properties.VisiblityType = Block->VisiblityType;
+		Properties.bPolygonize = Block->ShouldBePolygonized();
+		Properties.bDoCollisions = Block->bDoCollisions;
+		Properties.bIsEmptyBlock = Block->bIsEmptyBlock;
+
+		if (!Properties.bPolygonize) continue;
+
+		if (Block->bSeparateMeshSections)
+		{
+			Properties.SectionKey = NumSectionKeys++;
+		}
+		else if (int32* Find = MaterialSectionKeys.Find(Block->Material))
+		{
+			Properties.SectionKey = *Find;
+		}
+		else
+		{
+			Properties.SectionKey = NumSectionKeys++;
+			MaterialSectionKeys.Add(Block->Material, Properties.SectionKey);
+		}
+	}
+}
 
 void FBlockRegistry::FindVoxelBlocks(TArray<TWeakObjectPtr<UClass>>& BlockClassesOut)
 {
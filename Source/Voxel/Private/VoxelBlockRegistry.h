@@ -5,12 +5,36 @@
 
 class UVoxelBlockDef;
 
+//Copy of UVoxelBlockDef fields needed in hot paths, so they can be read without touching the UObject
+struct alignas(16) FVoxelBlockProperties
+{
+	FColor DefaultColor = FColor::White;
+
+	int32 VisiblityType = 0;
+
+	//Blocks sharing mesh section have same SectionKey, INDEX_NONE if not polygonized
+	int32 SectionKey = INDEX_NONE;
+
+	bool bPolygonize = false;
+	bool bDoCollisions = false;
+	bool bIsEmptyBlock = true;
+};
+
+typedef TArray<FVoxelBlockProperties, TAlignedHeapAllocator<PLATFORM_CACHE_LINE_SIZE>> FVoxelBlockPropertiesArray;
+
 class FBlockRegistryInstance
 {
 private:
 	TMap<FName, UVoxelBlockDef*> BlockInstanceRegistry;
 	TArray<UVoxelBlockDef*> UniqueIndices;
 
+	//Indexed by TypeId, same size as UniqueIndices
+	FVoxelBlockPropertiesArray BlockProperties;
+
+	int NumSectionKeys = 0;
+
+	void BuildBlockProperties();
+
 public:
 	FBlockRegistryInstance();
 	~FBlockRegistryInstance();
@@ -35,6 +59,18 @@ public:
 		return UniqueIndices[Index];
 	}
 
+	//No checks in shipping code, Index must be valid
+	inline const FVoxelBlockProperties& GetBlockProperties(const uint32 Index) const
+	{
+		checkSlow(BlockProperties.IsValidIndex(Index));
+		return BlockProperties.GetData()[Index];
+	}
+
+	int GetNumSectionKeys() const
+	{
+		return NumSectionKeys;
+	}
+
 	UVoxelBlockDef* GetBlockInternal(FName Name)
 	{
 		UVoxelBlockDef** Find = BlockInstanceRegistry.Find(Name);
@@ -117,4 +153,11 @@ public:
 
 	//Macro only
 	static FBlockRegistryInstance* GetInstance_Ptr();
+
+	//Hot path version of GetInstance_Ptr()->GetBlockProperties, no checks in shipping code
+	static inline const FVoxelBlockProperties& GetBlockProperties(const uint32 Index)
+	{
+		checkSlow(InstancePtrRaw);
+		return InstancePtrRaw->GetBlockProperties(Index);
+	}
 };
\ No newline at end of file
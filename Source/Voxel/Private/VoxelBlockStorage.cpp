@@ -0,0 +1,291 @@
+#include "VoxelBlockStorage.h"
+
+static inline int GetIndexLayerSizeIndex(const int BitsPerIndex)
+{
+	return FMath::FloorLog2(BitsPerIndex);
+}
+
+static inline int GetIndexLayerNum(const int BitsPerIndex)
+{
+	return VOX_ARRAYSIZE / (32 / BitsPerIndex);
+}
+
+FVoxelBlockStorage::FVoxelBlockStorage(FVoxelStorageLayerPools* InLayerPools)
+	: LayerPools(InLayerPools)
+{
+	check(LayerPools);
+
+	//Every voxel starts as the default block (Empty, white), no index array until first differing SetBlock
+	Palette.Add(0);
+	PaletteColors.Add(FColor::White);
+}
+
+FVoxelBlockStorage::FVoxelBlockStorage(const FVoxelBlockStorage& Other)
+	: LayerPools(Other.LayerPools)
+	, Palette(Other.Palette)
+	, PaletteColors(Other.PaletteColors)
+	, BitsPerIndex(Other.BitsPerIndex)
+{
+	if (!Other.IsUniform())
+	{
+		LayerPools->IndexLayers.Acquire(GetIndexLayerSizeIndex(BitsPerIndex), Other.PackedIndices.Num(), PackedIndices);
+		FMemory::Memcpy(PackedIndices.GetData(), Other.PackedIndices.GetData(), PackedIndices.Num() * sizeof(uint32));
+	}
+
+	if (Other.HasColorLayer())
+	{
+		LayerPools->ColorLayers.Acquire(0, VOX_ARRAYSIZE, Colors);
+		FMemory::Memcpy(Colors.GetData(), Other.Colors.GetData(), VOX_ARRAYSIZE * sizeof(FColor));
+	}
+}
+
+FVoxelBlockStorage::~FVoxelBlockStorage()
+{
+	ReleaseIndices();
+	ReleaseColors();
+}
+
+void FVoxelBlockStorage::ReleaseIndices()
+{
+	if (!IsUniform())
+	{
+		LayerPools->IndexLayers.Release(GetIndexLayerSizeIndex(BitsPerIndex), PackedIndices);
+	}
+}
+
+void FVoxelBlockStorage::ReleaseColors()
+{
+	LayerPools->ColorLayers.Release(0, Colors);
+}
+
+void FVoxelBlockStorage::GetBlockIds(uint32* OutIds, const int RowStride, const int SliceStride) const
+{
+	const int IndicesPerWord = IsUniform() ? VOX_CHUNKSIZE : 32 / BitsPerIndex;
+	const uint32 Mask = (1u << BitsPerIndex) - 1;
+
+	for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
+	{
+		for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+		{
+			uint32* Row = OutIds + Y * RowStride + Z * SliceStride;
+
+			if (IsUniform())
+			{
+				for (int X = 0; X < VOX_CHUNKSIZE; X++)
+				{
+					Row[X] = Palette[0];
+				}
+				continue;
+			}
+
+			//A row always starts at word boundary
+			const int FirstWord = FVoxelUtilities::GetArrayIndex(0, Y, Z) / IndicesPerWord;
+
+			for (int WordIndex = FirstWord; WordIndex < FirstWord + VOX_CHUNKSIZE / IndicesPerWord; WordIndex++)
+			{
+				uint32 Word = PackedIndices[WordIndex];
+
+				for (int SubIndex = 0; SubIndex < IndicesPerWord; SubIndex++)
+				{
+					*Row++ = Palette[Word & Mask];
+					Word >>= BitsPerIndex;
+				}
+			}
+		}
+	}
+}
+
+void FVoxelBlockStorage::SetBlock(const int LocalX, const int LocalY, const int LocalZ, UVoxelBlockDef* BlockDef, FColor Color)
+{
+	const int Index = FVoxelUtilities::GetArrayIndex(LocalX, LocalY, LocalZ);
+
+	if (Color != BlockDef->DefaultColor && !HasColorLayer())
+	{
+		AddColorLayer();
+	}
+
+	if (HasColorLayer())
+	{
+		Colors[Index] = Color;
+	}
+
+	if (IsUniform())
+	{
+		if (Palette[0] == BlockDef->TypeId)
+		{
+			return;
+		}
+
+		//Becomes a real array now
+		Repack(MinBitsPerIndex);
+	}
+
+	SetPaletteIndex(Index, FindOrAddPaletteEntry(BlockDef));
+}
+
+void FVoxelBlockStorage::Fill(UVoxelBlockDef* BlockDef, FColor Color)
+{
+	Palette.Reset(1);
+	Palette.Add(BlockDef->TypeId);
+
+	PaletteColors.Reset(1);
+	PaletteColors.Add(BlockDef->DefaultColor);
+
+	ReleaseIndices();
+	BitsPerIndex = 0;
+
+	if (Color != BlockDef->DefaultColor)
+	{
+		if (!HasColorLayer())
+		{
+			LayerPools->ColorLayers.Acquire(0, VOX_ARRAYSIZE, Colors);
+		}
+
+		for (FColor& VoxelColor : Colors)
+		{
+			VoxelColor = Color;
+		}
+	}
+	else
+	{
+		ReleaseColors();
+	}
+}
+
+void FVoxelBlockStorage::Compact()
+{
+	if (!IsUniform())
+	{
+		CompactPalette();
+
+		if (Palette.Num() == 1)
+		{
+			ReleaseIndices();
+			BitsPerIndex = 0;
+		}
+	}
+
+	if (HasColorLayer())
+	{
+		for (int Index = 0; Index < VOX_ARRAYSIZE; Index++)
+		{
+			if (Colors[Index] != PaletteColors[GetPaletteIndex(Index)])
+			{
+				return;
+			}
+		}
+
+		//Every voxel has its default color
+		ReleaseColors();
+	}
+}
+
+int FVoxelBlockStorage::FindOrAddPaletteEntry(UVoxelBlockDef* BlockDef)
+{
+	const uint32 BlockId = BlockDef->TypeId;
+
+	//Palettes are small, linear search is faster than hashing here
+	for (int PaletteIndex = 0; PaletteIndex < Palette.Num(); PaletteIndex++)
+	{
+		if (Palette[PaletteIndex] == BlockId)
+		{
+			return PaletteIndex;
+		}
+	}
+
+	//Palette is full for current index width
+	if (Palette.Num() >= (1 << BitsPerIndex))
+	{
+		CompactPalette();
+
+		if (Palette.Num() >= (1 << BitsPerIndex))
+		{
+			check(BitsPerIndex < MaxBitsPerIndex);
+			Repack(BitsPerIndex * 2);
+		}
+	}
+
+	PaletteColors.Add(BlockDef->DefaultColor);
+	return Palette.Add(BlockId);
+}
+
+void FVoxelBlockStorage::AddColorLayer()
+{
+	check(!HasColorLayer());
+
+	LayerPools->ColorLayers.Acquire(0, VOX_ARRAYSIZE, Colors);
+
+	for (int Index = 0; Index < VOX_ARRAYSIZE; Index++)
+	{
+		Colors[Index] = PaletteColors[GetPaletteIndex(Index)];
+	}
+}
+
+void FVoxelBlockStorage::CompactPalette()
+{
+	TArray<int> Remap;
+	Remap.Init(INDEX_NONE, Palette.Num());
+
+	for (int Index = 0; Index < VOX_ARRAYSIZE; Index++)
+	{
+		Remap[GetPaletteIndex(Index)] = 0;
+	}
+
+	TArray<uint32> NewPalette;
+	TArray<FColor> NewPaletteColors;
+	NewPalette.Reserve(Palette.Num());
+	NewPaletteColors.Reserve(Palette.Num());
+
+	for (int PaletteIndex = 0; PaletteIndex < Palette.Num(); PaletteIndex++)
+	{
+		if (Remap[PaletteIndex] != INDEX_NONE)
+		{
+			Remap[PaletteIndex] = NewPalette.Add(Palette[PaletteIndex]);
+			NewPaletteColors.Add(PaletteColors[PaletteIndex]);
+		}
+	}
+
+	//Nothing to remove
+	if (NewPalette.Num() == Palette.Num())
+	{
+		return;
+	}
+
+	for (int Index = 0; Index < VOX_ARRAYSIZE; Index++)
+	{
+		SetPaletteIndex(Index, Remap[GetPaletteIndex(Index)]);
+	}
+
+	Palette = MoveTemp(NewPalette);
+	PaletteColors = MoveTemp(NewPaletteColors);
+}
+
+void FVoxelBlockStorage::Repack(const int NewBitsPerIndex)
+{
+	check(NewBitsPerIndex <= MaxBitsPerIndex && FMath::IsPowerOfTwo(NewBitsPerIndex));
+
+	TArray<uint32> OldPackedIndices = MoveTemp(PackedIndices);
+	const int OldBitsPerIndex = BitsPerIndex;
+
+	BitsPerIndex = NewBitsPerIndex;
+
+	LayerPools->IndexLayers.Acquire(GetIndexLayerSizeIndex(BitsPerIndex), GetIndexLayerNum(BitsPerIndex), PackedIndices);
+	FMemory::Memzero(PackedIndices.GetData(), PackedIndices.Num() * sizeof(uint32));
+
+	//Uniform storage is all palette index 0, nothing to copy
+	if (OldBitsPerIndex == 0)
+	{
+		return;
+	}
+
+	const int OldIndicesPerWord = 32 / OldBitsPerIndex;
+	const uint32 OldMask = (1u << OldBitsPerIndex) - 1;
+
+	for (int Index = 0; Index < VOX_ARRAYSIZE; Index++)
+	{
+		const int Shift = (Index % OldIndicesPerWord) * OldBitsPerIndex;
+		SetPaletteIndex(Index, (OldPackedIndices[Index / OldIndicesPerWord] >> Shift) & OldMask);
+	}
+
+	LayerPools->IndexLayers.Release(GetIndexLayerSizeIndex(OldBitsPerIndex), OldPackedIndices);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelUtilities.h"
+#include "VoxelPool.h"
+
+//Palette compressed block storage of a chunk
+//Block ids and colors are stored as separate layers.
+//Every voxel stores an index into a small per-chunk palette of block ids,
+//bit-packed with a width that grows as the palette grows.
+//A chunk made of one block is uniform : it keeps only Palette[0] and no index array at all.
+//The color layer is only allocated once a voxel gets a color other than its block's DefaultColor.
+//Storage has no lock itself, chunks share it with snapshots and clone it on write (See UVoxelChunk).
+class FVoxelBlockStorage
+{
+private:
+	//Index and color layers are taken from and given back to these
+	FVoxelStorageLayerPools* LayerPools;
+
+	//Unique block ids used in this chunk
+	TArray<uint32> Palette;
+
+	//DefaultColor of each palette entry, used when there's no color layer
+	TArray<FColor> PaletteColors;
+
+	//Bit-packed palette indices, BitsPerIndex is power of two so an index never straddles two words
+	//Empty when uniform
+	TArray<uint32> PackedIndices;
+
+	//0 - Uniform
+	int BitsPerIndex = 0;
+
+	//Per voxel colors, empty if every voxel has its default color
+	TArray<FColor> Colors;
+
+public:
+	static constexpr int MinBitsPerIndex = 1;
+	static constexpr int MaxBitsPerIndex = 16;
+
+	//InLayerPools must outlive the storage
+	FVoxelBlockStorage(FVoxelStorageLayerPools* InLayerPools);
+	FVoxelBlockStorage(const FVoxelBlockStorage& Other);
+	~FVoxelBlockStorage();
+
+	FVoxelBlockStorage& operator=(const FVoxelBlockStorage&) = delete;
+
+	FVoxelBlock GetBlock(const int LocalX, const int LocalY, const int LocalZ) const
+	{
+		const int Index = FVoxelUtilities::GetArrayIndex(LocalX, LocalY, LocalZ);
+		const uint32 PaletteIndex = GetPaletteIndex(Index);
+
+		FVoxelBlock Block;
+		Block.BlockId = Palette[PaletteIndex];
+		Block.Color = HasColorLayer() ? Colors[Index] : PaletteColors[PaletteIndex];
+
+		return Block;
+	};
+
+	uint32 GetBlockId(const int LocalX, const int LocalY, const int LocalZ) const
+	{
+		return Palette[GetPaletteIndex(FVoxelUtilities::GetArrayIndex(LocalX, LocalY, LocalZ))];
+	};
+
+	FColor GetColor(const int LocalX, const int LocalY, const int LocalZ) const
+	{
+		const int Index = FVoxelUtilities::GetArrayIndex(LocalX, LocalY, LocalZ);
+
+		return HasColorLayer() ? Colors[Index] : PaletteColors[GetPaletteIndex(Index)];
+	};
+
+	//Decodes block ids of the whole chunk, OutIds should have VOX_ARRAYSIZE elements
+	void GetBlockIds(uint32* OutIds) const
+	{
+		GetBlockIds(OutIds, VOX_CHUNKSIZE, VOX_CHUNKSIZE * VOX_CHUNKSIZE);
+	};
+
+	//Decodes block ids of the whole chunk into an array with given strides of Y and Z
+	void GetBlockIds(uint32* OutIds, const int RowStride, const int SliceStride) const;
+
+	//Set block with color
+	void SetBlock(const int LocalX, const int LocalY, const int LocalZ, UVoxelBlockDef* BlockDef, FColor Color);
+
+	//Set block with default color
+	void SetBlock(const int LocalX, const int LocalY, const int LocalZ, UVoxelBlockDef* BlockDef)
+	{
+		SetBlock(LocalX, LocalY, LocalZ, BlockDef, BlockDef->DefaultColor);
+	};
+
+	//Fill whole chunk with one block, makes the storage uniform
+	void Fill(UVoxelBlockDef* BlockDef, FColor Color);
+
+	void Fill(UVoxelBlockDef* BlockDef)
+	{
+		Fill(BlockDef, BlockDef->DefaultColor);
+	};
+
+	//Drops unused palette entries and redundant color layer, and collapses to uniform if only one entry is left
+	void Compact();
+
+	bool IsUniform() const
+	{
+		return BitsPerIndex == 0;
+	};
+
+	//Only valid when IsUniform()
+	uint32 GetUniformBlockId() const
+	{
+		check(IsUniform());
+		return Palette[0];
+	};
+
+	bool HasColorLayer() const
+	{
+		return Colors.Num() != 0;
+	};
+
+	int GetPaletteSize() const
+	{
+		return Palette.Num();
+	};
+
+	int GetBitsPerIndex() const
+	{
+		return BitsPerIndex;
+	};
+
+	//Heap memory used by this storage
+	SIZE_T GetAllocatedSize() const
+	{
+		return Palette.GetAllocatedSize() + PaletteColors.GetAllocatedSize() + PackedIndices.GetAllocatedSize() + Colors.GetAllocatedSize();
+	};
+
+private:
+	inline uint32 GetPaletteIndex(const int Index) const
+	{
+		if (IsUniform())
+		{
+			return 0;
+		}
+
+		const int IndicesPerWord = 32 / BitsPerIndex;
+		const int Shift = (Index % IndicesPerWord) * BitsPerIndex;
+
+		return (PackedIndices[Index / IndicesPerWord] >> Shift) & ((1u << BitsPerIndex) - 1);
+	};
+
+	inline void SetPaletteIndex(const int Index, const uint32 PaletteIndex)
+	{
+		const int IndicesPerWord = 32 / BitsPerIndex;
+		const int Shift = (Index % IndicesPerWord) * BitsPerIndex;
+		const uint32 Mask = ((1u << BitsPerIndex) - 1) << Shift;
+
+		uint32& Word = PackedIndices[Index / IndicesPerWord];
+		Word = (Word & ~Mask) | (PaletteIndex << Shift);
+	};
+
+	int FindOrAddPaletteEntry(UVoxelBlockDef* BlockDef);
+
+	//Allocates color layer, filled with default colors
+	void AddColorLayer();
+
+	//Removes palette entries no voxel references anymore
+	void CompactPalette();
+
+	//Layers back to their free list
+	void ReleaseIndices();
+	void ReleaseColors();
+
+	void Repack(const int NewBitsPerIndex);
+};
+
+typedef TSharedPtr<FVoxelBlockStorage, ESPMode::ThreadSafe> FVoxelBlockStoragePtr;
+
+//Immutable view of a chunk's storage at some version
+struct FVoxelStorageSnapshot
+{
+	TSharedPtr<const FVoxelBlockStorage, ESPMode::ThreadSafe> Storage;
+
+	//Incremented on every change of the chunk's storage
+	uint64 Version = 0;
+
+	bool IsValid() const
+	{
+		return Storage.IsValid();
+	}
+};
@@ -1,5 +1,6 @@
 #include "VoxelChunk.h"
 #include "VoxelRMCProvider.h"
+#include "VoxelRegionProvider.h"
 #include "VoxelWorld.h"
 #include "VoxelWorldGenerator.h"
 #include "VoxelMesher.h"
@@ -9,34 +10,89 @@ UVoxelChunk::UVoxelChunk(UVoxelWorld* InVoxelWorld, FIntVector Pos)
 	VoxelWorld = InVoxelWorld;
 	ChunkPos = Pos;
 
-	BlockStorage = new FVoxelBlockStorage();
+	for (auto& Neighbor : Neighbors)
+	{
+		Neighbor = nullptr;
+	}
+
+	BlockStorage = VoxelWorld->NewBlockStorage();
 }
 
 UVoxelChunk::~UVoxelChunk()
 {
-	delete BlockStorage;
+	BlockStorage = nullptr;
+}
+
+FVoxelStorageSnapshot UVoxelChunk::GetSnapshot() const
+{
+	FScopeLock Lock(&StorageLock);
+
+	FVoxelStorageSnapshot Snapshot;
+	Snapshot.Storage = BlockStorage;
+	Snapshot.Version = StorageVersion;
+
+	return Snapshot;
 }
 
-FVoxelBlockStorage* UVoxelChunk::GetBlockStorage()
+uint64 UVoxelChunk::GetStorageVersion() const
 {
-	return BlockStorage;
+	FScopeLock Lock(&StorageLock);
+	return StorageVersion;
 }
 
 void UVoxelChunk::SetBlock(int LocalX, int LocalY, int LocalZ, UVoxelBlockDef* BlockDef, FColor Color)
 {
-	BlockStorage->WriteLock();
-	BlockStorage->SetBlock(LocalX, LocalY, LocalZ, BlockDef, Color);
-	BlockStorage->WriteUnlock();
+	{
+		FScopeLock Lock(&StorageLock);
+
+		//Some snapshot is still using current storage, copy on write
+		if (!BlockStorage.IsUnique())
+		{
+			BlockStorage = VoxelWorld->NewBlockStorage(BlockStorage.Get());
+		}
+
+		BlockStorage->SetBlock(LocalX, LocalY, LocalZ, BlockDef, Color);
+		StorageVersion++;
+
+		//Generation in progress would replace this storage
+		if (!bIsStorageGenerated)
+		{
+			PendingEdits.Add({ FIntVector(LocalX, LocalY, LocalZ), BlockDef, Color });
+		}
+	}
+
+	//In cooldown already has an entry, it waits for the new cooldown when it expires
+	const bool bIsQueued = VoxelWorld->IsInBatchCooldown(this);
+
+	LastEditTime = FPlatformTime::Seconds();
+
+	if (!bIsQueued)
+	{
+		VoxelWorld->QueueBatchCooldown(this);
+	}
+
+	bHasPendingEdit = true;
 	SetChunkDirty();
 }
 
 void UVoxelChunk::Tick()
 {
-	if (VoxelWorld->ShouldBeDestroyed(ChunkPos) && VoxelWorld->TryUpdate())
+	//Something is waiting for update budget, tick again next frame
+	bool bStayActive = false;
+
+	if (ChunkState != EChunkState::Destroyed && VoxelWorld->ShouldBeDestroyed(ChunkPos))
 	{
-		DestroyChunk();
+		if (VoxelWorld->TryUpdate())
+		{
+			FVoxelUpdateScope UpdateScope(VoxelWorld);
+			DestroyChunk();
 
-		ChunkState = EChunkState::Destroyed;
+			ChunkState = EChunkState::Destroyed;
+		}
+		else
+		{
+			bStayActive = true;
+		}
 	}
 
 	if (ChunkState == EChunkState::Destroyed)
@@ -68,9 +124,35 @@ void UVoxelChunk::Tick()
 
 	if (ChunkState == EChunkState::Rendered)
 	{
-		if (RMCProvider == nullptr)
+		const bool bShouldBeBatched = VoxelWorld->ShouldBeBatched(this);
+
+		//Switching waits for mesh works in flight, finishing one activates the chunk again
+		const bool bIsMeshWorkPending = MeshAndCollisionWork.bIsWorkOnline || MeshWork.bIsWorkOnline || MeshWork.bIsDelaying;
+
+		if (!HasMeshTarget() || (bShouldBeBatched != bIsBatched && !bIsMeshWorkPending))
 		{
-			VoxelWorld->SetupMesh(this);
+			if (VoxelWorld->TryUpdate())
+			{
+				const bool bIsFirstMesh = !HasMeshTarget();
+				{
+					FVoxelUpdateScope UpdateScope(VoxelWorld);
+					SetupMesh(bShouldBeBatched);
+				}
+
+				if (bIsFirstMesh)
+				{
+					SatisfyMeshDependency(MeshDependencyMeshReady);
+				}
+				else
+				{
+					//New target has nothing yet, old one is shown until it does
+					SetChunkDirty();
+				}
+			}
+			else
+			{
+				bStayActive = true;
+			}
 		}
 
 		if (WorldGenerationPhase == 0)
@@ -79,21 +161,14 @@ void UVoxelChunk::Tick()
 
 			VoxelWorld->QueueChunkWork(this, EChunkWorkType::WorldGen);
 		}
-		
-		if (WorldGenerationPhase == 2)
-		{
-			SetChunkDirty();
-			SetAdjacentChunkDirty();
-
-			WorldGenerationPhase = 3;
-		}
 
-		if (bIsChunkDirty && RMCProvider)
+		//First mesh is queued by the last dependency, until then there is nothing to redo
+		if (bIsChunkDirty && HasMeshDependencies())
 		{
-			VoxelWorld->QueueChunkWork(this, EChunkWorkType::Collision);
-			VoxelWorld->QueueChunkWork(this, EChunkWorkType::Mesh);
+			QueueMeshWorks(bHasPendingEdit);
 
 			bIsChunkDirty = false;
+			bHasPendingEdit = false;
 		}
 	}
 
@@ -101,80 +176,249 @@ void UVoxelChunk::Tick()
 	{
 		WorldGenerationPhase = 2;
 	}
+	if (WorldGenWork.WasCancelled())
+	{
+		WorldGenerationPhase = 0;
+	}
+	if (CollisionWork.WasCancelled() || MeshWork.WasCancelled() || MeshAndCollisionWork.WasCancelled())
+	{
+		SetChunkDirty();
+	}
+	for (FChunkWork* Work : { &CollisionWork, &MeshWork, &MeshAndCollisionWork })
+	{
+		//Finishing activates the chunk, so this is seen after the running one is done
+		if (!Work->bIsWorkOnline && Work->bIsRerunRequested.AtomicSet(false))
+		{
+			SetChunkDirty();
+		}
+	}
+	if (MeshAndCollisionWork.IsDone())
+	{
+		//Upload both below, same as if each was done alone
+		MeshWork.StorageVersion = MeshAndCollisionWork.StorageVersion.Load();
+		CollisionWork.StorageVersion = MeshAndCollisionWork.StorageVersion.Load();
+
+		MeshWork.bIsDelaying = true;
+		CollisionWork.bIsDelaying = true;
+	}
 	if (CollisionWork.IsDone() || CollisionWork.bIsDelaying)
 	{
 		if (VoxelWorld->TryUpdate())
 		{
-			UpdateCollision();
+			{
+				FVoxelUpdateScope UpdateScope(VoxelWorld);
+				UpdateCollision();
+			}
 			CollisionWork.bIsDelaying = false;
+
+			//Storage changed while working, do it again
+			if (CollisionWork.StorageVersion != GetStorageVersion())
+			{
+				SetChunkDirty();
+			}
 		}
 		else
 		{
 			CollisionWork.bIsDelaying = true;
+			bStayActive = true;
 		}
 	}
 	if (MeshWork.IsDone() || MeshWork.bIsDelaying)
 	{
 		if (VoxelWorld->TryUpdate())
 		{
-			UpdateMesh();
+			{
+				FVoxelUpdateScope UpdateScope(VoxelWorld);
+				UpdateMesh();
+			}
 			MeshWork.bIsDelaying = false;
+
+			//Storage changed while working, do it again
+			if (MeshWork.StorageVersion != GetStorageVersion())
+			{
+				SetChunkDirty();
+			}
+			//Edit meshes come without LODs, a mesh work queued like any other, behind edits, builds only them
+			else if (AreLODsOutdated())
+			{
+				VoxelWorld->QueueChunkWork(this, EChunkWorkType::Mesh);
+			}
 		}
 		else
 		{
 			MeshWork.bIsDelaying = true;
+			bStayActive = true;
 		}
 	}
+
+	if (bStayActive)
+	{
+		VoxelWorld->ActivateChunk(this);
+	}
 }
 
 void UVoxelChunk::DestroyChunk()
 {
-	if (RMC)
-	{
-		VoxelWorld->ReleaseMesh(RMC);
-	}
+	bIsDestroying = true;
+
+	ReleaseMeshTargets(false);
 
 	VoxelWorld->OnChunkDestroyed(this);
 }
 
 bool UVoxelChunk::IsReadyForFinishDestroy()
 {
-	return RemainingWorks.GetValue() == 0;
+	//Works activate the chunk before they decrement RemainingWorks, so check that first
+	return RemainingWorks.GetValue() == 0 && !bIsActive;
 }
 
-void UVoxelChunk::GenerateChunk()
+bool UVoxelChunk::GenerateChunk()
 {
 	check(WorldGenerationPhase == 1);
 
-	BlockStorage->WriteLock();
+	if (IsDestroying())
+	{
+		return false;
+	}
+
+	//Generate into a private storage, then publish it. Readers are never blocked by generation.
+	FVoxelBlockStoragePtr NewStorage = VoxelWorld->NewBlockStorage();
+
+	VoxelWorld->WorldGenerator->GenerateChunk(this, *NewStorage);
+
+	//Nobody will see it
+	if (IsDestroying())
+	{
+		return false;
+	}
+
+	//Generators write voxel by voxel, collapse chunks that ended up made of one block
+	NewStorage->Compact();
+
+	{
+		FScopeLock Lock(&StorageLock);
+
+		//Edits made while generating go on top, in order
+		for (const FVoxelPendingEdit& Edit : PendingEdits)
+		{
+			NewStorage->SetBlock(Edit.LocalPos.X, Edit.LocalPos.Y, Edit.LocalPos.Z, Edit.BlockDef, Edit.Color);
+		}
+		PendingEdits.Empty();
+
+		BlockStorage = NewStorage;
+		StorageVersion++;
+
+		bIsStorageGenerated = true;
+	}
+
+	SatisfyMeshDependency(MeshDependencyGenerated);
+
+	//Neighbors linked after this point see IsGenerated instead, see UVoxelWorld::NewChunk
+	FVoxelChunkMap::FReadScope ReadScope(VoxelWorld->GetChunkMap());
+
+	for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+	{
+		const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+
+		UVoxelChunk* Neighbor = GetNeighbor(Face);
+		if (Neighbor)
+		{
+			Neighbor->SatisfyMeshDependency(1 << static_cast<uint8>(FVoxelUtilities::GetOppositeFace(Face)));
+		}
+	}
+
+	return true;
+}
+
+bool UVoxelChunk::PolygonizeChunk()
+{
+	if (IsDestroying())
+	{
+		return false;
+	}
+
+	const FVoxelStorageSnapshot Snapshot = GetSnapshot();
 
-	VoxelWorld->WorldGenerator->GenerateChunk(this);
+	auto MeshData = VoxelWorld->AllocateMeshData();
 
-	BlockStorage->WriteUnlock();
+	//Mesh works only follow edit meshes, LOD 0 is uploaded already
+	FVoxelMesherParameters Params;
+	Params.bBuildLOD0 = false;
+
+	if (!VoxelWorld->GetMesher()->DoMesh(this, Snapshot, MeshData, Params))
+	{
+		VoxelWorld->DiscardMeshData(MoveTemp(MeshData));
+		return false;
+	}
+
+	SubmitMeshData(MoveTemp(MeshData));
+
+	MeshWork.StorageVersion = Snapshot.Version;
+
+	return true;
 }
 
-void UVoxelChunk::PolygonizeChunk()
+bool UVoxelChunk::BuildCollision()
 {
-	BlockStorage->ReadLock();
+	if (IsDestroying())
+	{
+		return false;
+	}
 
-	auto MeshData = RMCProvider->GetMeshDataPtr();
+	const FVoxelStorageSnapshot Snapshot = GetSnapshot();
+
+	auto ColData = VoxelWorld->AllocateCollisionData();
 
 	FVoxelMesherParameters Params;
-	
-	VoxelWorld->GetMesher()->DoMesh(this, MeshData, Params);
 
-	BlockStorage->ReadUnlock();
+	if (!VoxelWorld->GetMesher()->DoCollision(this, Snapshot, ColData, Params))
+	{
+		VoxelWorld->DiscardCollisionData(MoveTemp(ColData));
+		return false;
+	}
+
+	SubmitCollisionData(MoveTemp(ColData));
+
+	CollisionWork.StorageVersion = Snapshot.Version;
+
+	return true;
 }
 
-void UVoxelChunk::BuildCollision()
+bool UVoxelChunk::PolygonizeAndBuildCollision()
 {
-	BlockStorage->ReadLock();
+	if (IsDestroying())
+	{
+		return false;
+	}
+
+	const FVoxelStorageSnapshot Snapshot = GetSnapshot();
 
-	auto ColData = RMCProvider->GetCollisionDataPtr();
+	auto MeshData = VoxelWorld->AllocateMeshData();
+	auto ColData = VoxelWorld->AllocateCollisionData();
+
+	FVoxelMesherParameters Params;
+	Params.bBuildLODs = !MeshAndCollisionWork.bIsEdit;
+
+	if (!VoxelWorld->GetMesher()->DoMeshAndCollision(this, Snapshot, MeshData, ColData, Params))
+	{
+		VoxelWorld->DiscardMeshData(MoveTemp(MeshData));
+		VoxelWorld->DiscardCollisionData(MoveTemp(ColData));
+		return false;
+	}
 
-	VoxelWorld->GetMesher()->DoCollision(this, ColData);
+	SubmitMeshData(MoveTemp(MeshData));
+	SubmitCollisionData(MoveTemp(ColData));
 
-	BlockStorage->ReadUnlock();
+	MeshAndCollisionWork.StorageVersion = Snapshot.Version;
+
+	return true;
+}
+
+void UVoxelChunk::QueueMeshWorks(const bool bIsEdit)
+{
+	check(ChunkState == EChunkState::Rendered);
+
+	VoxelWorld->QueueChunkWork(this, EChunkWorkType::MeshAndCollision, bIsEdit);
 }
 
 FChunkWork& UVoxelChunk::GetChunkWork(EChunkWorkType Type)
@@ -187,6 +431,8 @@ FChunkWork& UVoxelChunk::GetChunkWork(EChunkWorkType Type)
 		return CollisionWork;
 	case EChunkWorkType::Mesh:
 		return MeshWork;
+	case EChunkWorkType::MeshAndCollision:
+		return MeshAndCollisionWork;
 	}
 
 	check(false);
@@ -196,35 +442,134 @@ FChunkWork& UVoxelChunk::GetChunkWork(EChunkWorkType Type)
 void UVoxelChunk::SetChunkDirty()
 {
 	bIsChunkDirty = true;
+
+	VoxelWorld->ActivateChunk(this);
 }
 
-void UVoxelChunk::SetAdjacentChunkDirty()
+void UVoxelChunk::SatisfyMeshDependency(const int32 Bits)
 {
-	for (int FaceNum = 0; FaceNum < 6; FaceNum++)
-	{
-		const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+	const int32 OldDependencies = FPlatformAtomics::InterlockedOr(&MeshDependencies, Bits);
 
-		UVoxelChunk* AdjacentChunk = VoxelWorld->GetChunk(ChunkPos + FVoxelUtilities::GetFaceOffset(Face));
-		if (AdjacentChunk)
-		{
-			AdjacentChunk->SetChunkDirty();
-		}
+	//Only one caller sees the mask completing. May be on a worker, so ChunkState is not read:
+	//MeshDependencyMeshReady is only set once the chunk is rendered, so it's the combined work
+	if (OldDependencies != MeshDependencyAll && (OldDependencies | Bits) == MeshDependencyAll)
+	{
+		VoxelWorld->QueueChunkWork(this, EChunkWorkType::MeshAndCollision);
 	}
 }
 
+void UVoxelChunk::ResetNeighborDependency(const EBlockFace Face)
+{
+	FPlatformAtomics::InterlockedAnd(&MeshDependencies, ~(1 << static_cast<uint8>(Face)));
+}
+
 void UVoxelChunk::UpdateMesh()
 {
-	RMCProvider->UpdateMesh();
+	const bool bIsUploaded = bIsBatched ? RegionProvider->UpdateChunkMesh(this) : RMCProvider->UpdateMesh();
+
+	if (bIsUploaded)
+	{
+		ReleaseMeshTargets(true);
+	}
+	else if (bIsBatched ? RMC != nullptr : RegionProvider != nullptr)
+	{
+		//Result went to the previous target while switching, mesh again for the current one
+		SetChunkDirty();
+	}
+}
+
+bool UVoxelChunk::AreLODsOutdated()
+{
+	if (bIsBatched)
+	{
+		return RegionProvider && RegionProvider->AreChunkLODsOutdated(this);
+	}
+
+	return RMCProvider && RMCProvider->AreLODsOutdated();
 }
 
 void UVoxelChunk::UpdateCollision()
 {
-	RMCProvider->UpdateCollision();
+	if (bIsBatched)
+	{
+		RegionProvider->UpdateChunkCollision(this);
+	}
+	else
+	{
+		RMCProvider->UpdateCollision();
+	}
 }
 
-void UVoxelChunk::InitMesh(URuntimeMeshComponent* Comp)
+void UVoxelChunk::SubmitMeshData(TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData)
 {
-	RMCProvider = CastChecked<UVoxelRMCProvider>(Comp->GetProvider());
-	RMC = Comp;
+	FScopeLock Lock(&MeshTargetLock);
+
+	if (bIsBatched && RegionProvider)
+	{
+		RegionProvider->SubmitMeshData(this, MoveTemp(MeshData));
+	}
+	else if (!bIsBatched && RMCProvider)
+	{
+		RMCProvider->SubmitMeshData(MoveTemp(MeshData));
+	}
+	else
+	{
+		//Destroyed while meshing
+		VoxelWorld->DiscardMeshData(MoveTemp(MeshData));
+	}
 }
 
+void UVoxelChunk::SubmitCollisionData(TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData)
+{
+	FScopeLock Lock(&MeshTargetLock);
+
+	if (bIsBatched && RegionProvider)
+	{
+		RegionProvider->SubmitCollisionData(this, MoveTemp(CollisionData));
+	}
+	else if (!bIsBatched && RMCProvider)
+	{
+		RMCProvider->SubmitCollisionData(MoveTemp(CollisionData));
+	}
+	else
+	{
+		VoxelWorld->DiscardCollisionData(MoveTemp(CollisionData));
+	}
+}
+
+void UVoxelChunk::SetupMesh(const bool bBatched)
+{
+	FScopeLock Lock(&MeshTargetLock);
+
+	if (bBatched && !RegionProvider)
+	{
+		RegionProvider = VoxelWorld->AddToRegion(this);
+	}
+
+	if (!bBatched && !RMC)
+	{
+		RMC = VoxelWorld->GetFreeMesh(this);
+		RMCProvider = CastChecked<UVoxelRMCProvider>(RMC->GetProvider());
+	}
+
+	bIsBatched = bBatched;
+}
+
+void UVoxelChunk::ReleaseMeshTargets(const bool bKeepCurrent)
+{
+	FScopeLock Lock(&MeshTargetLock);
+
+	if (RMC && !(bKeepCurrent && !bIsBatched))
+	{
+		VoxelWorld->ReleaseMesh(RMC);
+
+		RMC = nullptr;
+		RMCProvider = nullptr;
+	}
+
+	if (RegionProvider && !(bKeepCurrent && bIsBatched))
+	{
+		VoxelWorld->RemoveFromRegion(this, RegionProvider);
+		RegionProvider = nullptr;
+	}
+}
@@ -2,8 +2,11 @@
 
 #include "CoreMinimal.h"
 #include "VoxelUtilities.h"
+#include "VoxelBlockStorage.h"
+#include "VoxelJobScheduler.h"
 
 class UVoxelRMCProvider;
+class UVoxelRegionProvider;
 class UVoxelWorld;
 
 enum class EChunkState
@@ -18,113 +21,132 @@ enum class EChunkState
 	Destroyed
 };
 
-class FVoxelBlockStorage
+struct FChunkWork
 {
-private:
-	FVoxelBlock Blocks[VOX_ARRAYSIZE];
+	FThreadSafeBool bIsWorkOnline = false;
+	FThreadSafeBool bIsDone = false;
 
-	FRWLock RWLock;
+	//Dropped before or while running, set on worker thread
+	FThreadSafeBool bIsCancelled = false;
 
-public:
-	FVoxelBlock GetBlock(const int LocalX, const int LocalY, const int LocalZ)
-	{
-		return Blocks[FVoxelUtilities::GetArrayIndex(LocalX, LocalY, LocalZ)];
-	};
+	//Queued again while online, inputs may have changed after the running one read them
+	FThreadSafeBool bIsRerunRequested = false;
 
-	//Set block with color
-	void SetBlock(const int LocalX, const int LocalY, const int LocalZ, UVoxelBlockDef* BlockDef, FColor Color)
-	{
-		int Index = FVoxelUtilities::GetArrayIndex(LocalX, LocalY, LocalZ);
-
-		Blocks[Index].BlockId = BlockDef->TypeId;
-		Blocks[Index].Color = Color;
-	};
+	FThreadSafeCounter64 CurrentWorkId = -1;
 
-	//Set block with default color
-	void SetBlock(const int LocalX, const int LocalY, const int LocalZ, UVoxelBlockDef* BlockDef)
-	{
-		SetBlock(LocalX, LocalY, LocalZ, BlockDef, BlockDef->DefaultColor);
-	};
+	//Storage version the last finished work was done with, written by workers and read on game thread
+	TAtomic<uint64> StorageVersion { 0 };
 
-	void ReadLock()
-	{
-		RWLock.ReadLock();
-	};
+	//Queued by an edit, set before the job is queued and read by the running work
+	bool bIsEdit = false;
 
-	void ReadUnlock()
-	{
-		RWLock.ReadUnlock();
-	};
+	bool bIsDelaying = false;
 
-	void WriteLock()
+	bool IsDone()
 	{
-		RWLock.WriteLock();
-	};
+		return bIsDone.AtomicSet(false);
+	}
 
-	void WriteUnlock()
+	bool WasCancelled()
 	{
-		RWLock.WriteUnlock();
-	};
+		return bIsCancelled.AtomicSet(false);
+	}
 };
 
-enum class EChunkWorkType
+//Block set before the chunk was generated, applied on top of the generated blocks
+struct FVoxelPendingEdit
 {
-	WorldGen, Collision, Mesh
-};
-
-struct FChunkWork
-{
-	FThreadSafeBool bIsWorkOnline = false;
-	FThreadSafeBool bIsDone = false;
-
-	FThreadSafeCounter64 CurrentWorkId = -1;
-
-	bool bIsDelaying = false;
-
-	bool IsDone()
-	{
-		return bIsDone.AtomicSet(false);
-	}
+	FIntVector LocalPos;
+	UVoxelBlockDef* BlockDef;
+	FColor Color;
 };
 
 class UVoxelChunk
 {
 public:
+	//Bits of mesh dependencies. One per face neighbor generated in EBlockFace order, then these.
+	static const int32 MeshDependencyGenerated = 1 << 6;
+	static const int32 MeshDependencyMeshReady = 1 << 7;
+	static const int32 MeshDependencyAll = 0xFF;
+
 	FIntVector ChunkPos;
 
 	UVoxelWorld* VoxelWorld = nullptr;
 
 	FThreadSafeCounter RemainingWorks;
 
+	//In activation queue of the world, or being ticked
+	FThreadSafeBool bIsActive = false;
+
 protected:
 	URuntimeMeshComponent* RMC = nullptr;
 	UVoxelRMCProvider* RMCProvider = nullptr;
 
+	//Region the chunk is batched into, see UVoxelWorld::ShouldBeBatched
+	UVoxelRegionProvider* RegionProvider = nullptr;
+
+	//New meshes go to RegionProvider instead of own component.
+	//Previous one is kept until the first mesh is uploaded to the new one, so the chunk never disappears in between
+	bool bIsBatched = false;
+
+	//Guards mesh targets above, meshes are submitted from worker threads. Written on game thread only
+	mutable FCriticalSection MeshTargetLock;
+
+	//FPlatformTime::Seconds of last SetBlock, 0 if never edited
+	double LastEditTime = 0.0;
+
 	bool bIsChunkDirty = false;
 
-	//0 - Not generated, 1 - Generating, 2 - Generated, 3 - Dirty set
+	//Dirty because of SetBlock, remesh goes before other works
+	bool bHasPendingEdit = false;
+
+	//0 - Not generated, 1 - Generating, 2 - Generated
 	int WorldGenerationPhase = 0;
 
+	//Inputs of mesh and collision works, see MeshDependency*. Set from any thread,
+	//whoever sets the last bit queues the works, so meshing starts without waiting for a tick.
+	volatile int32 MeshDependencies = 0;
+
 	FChunkWork WorldGenWork;
 	FChunkWork CollisionWork;
 	FChunkWork MeshWork;
 
-	FVoxelBlockStorage* BlockStorage = nullptr;
+	//Once done, hands its result to MeshWork and CollisionWork to upload
+	FChunkWork MeshAndCollisionWork;
+
+	//Current storage, may be shared with snapshots of running works. Cloned on write if shared.
+	FVoxelBlockStoragePtr BlockStorage;
+
+	uint64 StorageVersion = 0;
+
+	//BlockStorage is the generated one, edits made before are also kept in PendingEdits
+	bool bIsStorageGenerated = false;
+	TArray<FVoxelPendingEdit> PendingEdits;
+
+	//Guards BlockStorage pointer, StorageVersion and pending edits only, never held while meshing
+	mutable FCriticalSection StorageLock;
 
 	EChunkState ChunkState = EChunkState::Init;
 
+	//Face neighbors in EBlockFace order, set by UVoxelWorld when chunks are created and finally destroyed
+	TAtomic<UVoxelChunk*> Neighbors[6];
+
+	//Set by DestroyChunk, running works check it at safe points
+	FThreadSafeBool bIsDestroying = false;
+
 public:
 	UVoxelChunk(UVoxelWorld* InVoxelWorld, FIntVector Pos);
 	~UVoxelChunk();
 
-	FVoxelBlockStorage* GetBlockStorage();
+	//Current storage and its version, stays valid and unchanged while held
+	FVoxelStorageSnapshot GetSnapshot() const;
+
+	uint64 GetStorageVersion() const;
 
-	FVoxelBlock GetBlock(const int LocalX, const int LocalY, const int LocalZ)
+	FVoxelBlock GetBlock(const int LocalX, const int LocalY, const int LocalZ) const
 	{
-		BlockStorage->ReadLock();
-		FVoxelBlock Block = BlockStorage->GetBlock(LocalX, LocalY, LocalZ);
-		BlockStorage->ReadUnlock();
-		return Block;;
+		FScopeLock Lock(&StorageLock);
+		return BlockStorage->GetBlock(LocalX, LocalY, LocalZ);
 	};
 
 	//Set block and mark chunk dirty
@@ -147,25 +169,92 @@ public:
 		return ChunkState;
 	}
 
-	void GenerateChunk();
+	bool IsDestroying() const
+	{
+		return bIsDestroying;
+	}
+
+	//Lock-free. Same lifetime rule as UVoxelWorld::GetChunk, hold a read scope of chunk map on worker threads
+	UVoxelChunk* GetNeighbor(const EBlockFace Face) const
+	{
+		return Neighbors[static_cast<uint8>(Face)];
+	}
+
+	//Game thread only
+	void SetNeighbor(const EBlockFace Face, UVoxelChunk* Chunk)
+	{
+		Neighbors[static_cast<uint8>(Face)] = Chunk;
+	}
+
+	//Generated storage is published, thread safe
+	bool IsGenerated() const
+	{
+		return (FPlatformAtomics::AtomicRead(&MeshDependencies) & MeshDependencyGenerated) != 0;
+	}
+
+	bool HasMeshDependencies() const
+	{
+		return FPlatformAtomics::AtomicRead(&MeshDependencies) == MeshDependencyAll;
+	}
+
+	//Thread safe, queues mesh and collision works if this completes the dependencies
+	void SatisfyMeshDependency(const int32 Bits);
+
+	//Neighbor is gone, mesh again when the next one is generated. Game thread only
+	void ResetNeighborDependency(const EBlockFace Face);
+
+	//Works return false if cancelled before finishing
 
-	void PolygonizeChunk();
+	bool GenerateChunk();
 
-	void BuildCollision();
+	bool PolygonizeChunk();
+
+	bool BuildCollision();
+
+	bool PolygonizeAndBuildCollision();
+
+	//Combined mesh and collision work. Rendered chunks only, others have no target for either. Game thread only
+	void QueueMeshWorks(const bool bIsEdit);
 
 	//Mesh should be recreated
 	void SetChunkDirty();
 
-	void SetAdjacentChunkDirty();
-
 	//Update chunk mesh
 	void UpdateMesh();
 
+	//Uploaded mesh is an edit mesh newer than the LODs shown, see FVoxelMeshData::bHasLODs. Game thread
+	bool AreLODsOutdated();
+
 	void UpdateCollision();
 
-	void InitMesh(URuntimeMeshComponent* Comp);
+	//Finished buffers to the current mesh target, discarded if there is none. Any thread
+	void SubmitMeshData(TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData);
+	void SubmitCollisionData(TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData);
+
+	//Sends new meshes to its region or to own component, creating it if needed. Game thread only
+	void SetupMesh(const bool bBatched);
+
+	//Game thread only
+	bool HasMeshTarget() const
+	{
+		return bIsBatched ? RegionProvider != nullptr : RMCProvider != nullptr;
+	}
+
+	bool IsBatched() const
+	{
+		return bIsBatched;
+	}
+
+	//bKeepCurrent - Only the one bIsBatched doesn't use anymore, once the current one has a mesh.
+	//Game thread only, everything must be released before the chunk is deleted
+	void ReleaseMeshTargets(const bool bKeepCurrent);
+
+	double GetLastEditTime() const
+	{
+		return LastEditTime;
+	}
 
-	inline FIntVector GetMinPos()
+	inline FIntVector GetMinPos() const
 	{
 		return ChunkPos * VOX_CHUNKSIZE;
 	}
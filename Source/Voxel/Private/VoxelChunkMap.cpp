@@ -0,0 +1,233 @@
+#include "VoxelChunkMap.h"
+
+static const int32 MinCapacity = 1024;
+
+FVoxelChunkMap::FTable::FTable(const int32 InCapacity)
+{
+	check(FMath::IsPowerOfTwo(InCapacity));
+
+	Capacity = InCapacity;
+
+	Keys = MakeUnique<uint64[]>(Capacity);
+	Values = MakeUnique<TAtomic<UVoxelChunk*>[]>(Capacity);
+
+	for (int32 Index = 0; Index < Capacity; Index++)
+	{
+		Values[Index] = nullptr;
+	}
+}
+
+FVoxelChunkMap::FReadScope::FReadScope(const FVoxelChunkMap& InMap)
+	: Map(InMap)
+{
+	while (true)
+	{
+		Epoch = Map.GlobalEpoch;
+		Map.ReaderCounts[Epoch & 1]++;
+
+		//Epoch advanced before we were counted, writer may have missed us
+		if (Map.GlobalEpoch == Epoch)
+		{
+			break;
+		}
+
+		Map.ReaderCounts[Epoch & 1]--;
+	}
+}
+
+FVoxelChunkMap::FReadScope::~FReadScope()
+{
+	Map.ReaderCounts[Epoch & 1]--;
+}
+
+FVoxelChunkMap::FVoxelChunkMap()
+{
+	CurrentTable = new FTable(MinCapacity);
+	GlobalEpoch = 0;
+	ReaderCounts[0] = 0;
+	ReaderCounts[1] = 0;
+}
+
+FVoxelChunkMap::~FVoxelChunkMap()
+{
+	ensureMsgf(RetiredChunks.Num() == 0, TEXT("FVoxelChunkMap destroyed with %d retired chunks"), RetiredChunks.Num());
+
+	for (auto& Retired : RetiredTables)
+	{
+		delete Retired.Object;
+	}
+
+	delete CurrentTable.Load();
+}
+
+UVoxelChunk* FVoxelChunkMap::Find(const FIntVector& ChunkPos) const
+{
+	const FTable* Table = CurrentTable;
+
+	const uint64 Key = PackKey(ChunkPos);
+	const uint32 Mask = Table->Capacity - 1;
+
+	uint32 Index = HashKey(Key) & Mask;
+
+	for (int32 Probe = 0; Probe < Table->Capacity; Probe++)
+	{
+		UVoxelChunk* Value = Table->Values[Index];
+
+		if (!Value)
+		{
+			return nullptr;
+		}
+
+		//Same key can be a tombstone first, then re-added further
+		if (Value != GetTombstone() && Table->Keys[Index] == Key)
+		{
+			return Value;
+		}
+
+		Index = (Index + 1) & Mask;
+	}
+
+	return nullptr;
+}
+
+void FVoxelChunkMap::Add(const FIntVector& ChunkPos, UVoxelChunk* Chunk)
+{
+	check(IsInGameThread());
+	check(Chunk && !Find(ChunkPos));
+
+	FTable* Table = CurrentTable;
+
+	//Keep load factor under half, tombstones included
+	if ((Table->NumUsed + 1) * 2 > Table->Capacity)
+	{
+		Rebuild(FMath::Max(MinCapacity, int32(FMath::RoundUpToPowerOfTwo((Num + 1) * 4))));
+		Table = CurrentTable;
+	}
+
+	Insert(*Table, PackKey(ChunkPos), Chunk);
+	Num++;
+}
+
+void FVoxelChunkMap::Remove(const FIntVector& ChunkPos)
+{
+	check(IsInGameThread());
+
+	FTable* Table = CurrentTable;
+
+	const uint64 Key = PackKey(ChunkPos);
+	const uint32 Mask = Table->Capacity - 1;
+
+	uint32 Index = HashKey(Key) & Mask;
+
+	for (int32 Probe = 0; Probe < Table->Capacity; Probe++)
+	{
+		UVoxelChunk* Value = Table->Values[Index];
+
+		if (!Value)
+		{
+			break;
+		}
+
+		if (Value != GetTombstone() && Table->Keys[Index] == Key)
+		{
+			Table->Values[Index] = GetTombstone();
+			Num--;
+			return;
+		}
+
+		Index = (Index + 1) & Mask;
+	}
+
+	ensureMsgf(false, TEXT("FVoxelChunkMap::Remove : No chunk at %s"), *ChunkPos.ToString());
+}
+
+void FVoxelChunkMap::Retire(UVoxelChunk* Chunk)
+{
+	check(IsInGameThread());
+
+	RetiredChunks.Add({ Chunk, GlobalEpoch });
+}
+
+void FVoxelChunkMap::Reclaim(TFunctionRef<void(UVoxelChunk*)> DeleteChunk, const bool bForce)
+{
+	check(IsInGameThread());
+
+	//No reader of previous epoch left, advance
+	const uint64 Epoch = GlobalEpoch;
+	if (ReaderCounts[(Epoch + 1) & 1] == 0)
+	{
+		GlobalEpoch = Epoch + 1;
+	}
+
+	//Readers that could see an object retired in epoch E are all gone at epoch E + 2
+	const uint64 SafeEpoch = GlobalEpoch;
+
+	RetiredChunks.RemoveAll([&](const TRetired<UVoxelChunk>& Retired)
+	{
+		if (bForce || Retired.Epoch + 2 <= SafeEpoch)
+		{
+			DeleteChunk(Retired.Object);
+			return true;
+		}
+		return false;
+	});
+
+	RetiredTables.RemoveAll([&](const TRetired<FTable>& Retired)
+	{
+		if (bForce || Retired.Epoch + 2 <= SafeEpoch)
+		{
+			delete Retired.Object;
+			return true;
+		}
+		return false;
+	});
+}
+
+void FVoxelChunkMap::Empty()
+{
+	check(IsInGameThread());
+
+	RetiredTables.Add({ CurrentTable.Load(), GlobalEpoch });
+	CurrentTable = new FTable(MinCapacity);
+
+	Num = 0;
+}
+
+void FVoxelChunkMap::Rebuild(const int32 NewCapacity)
+{
+	FTable* OldTable = CurrentTable;
+	FTable* NewTable = new FTable(NewCapacity);
+
+	for (int32 Index = 0; Index < OldTable->Capacity; Index++)
+	{
+		UVoxelChunk* Value = OldTable->Values[Index];
+
+		if (Value && Value != GetTombstone())
+		{
+			Insert(*NewTable, OldTable->Keys[Index], Value);
+		}
+	}
+
+	//Readers still probing the old table see the same entries
+	CurrentTable = NewTable;
+
+	RetiredTables.Add({ OldTable, GlobalEpoch });
+}
+
+void FVoxelChunkMap::Insert(FTable& Table, const uint64 Key, UVoxelChunk* Chunk)
+{
+	const uint32 Mask = Table.Capacity - 1;
+
+	uint32 Index = HashKey(Key) & Mask;
+
+	while (Table.Values[Index].Load() != nullptr)
+	{
+		Index = (Index + 1) & Mask;
+	}
+
+	//Key first, value publishes it
+	Table.Keys[Index] = Key;
+	Table.Values[Index] = Chunk;
+
+	Table.NumUsed++;
+}
@@ -0,0 +1,363 @@
+#include "VoxelFaceCulling.h"
+
+#define VOX_PADDEDROWS (VOX_PADDEDSIZE * VOX_PADDEDSIZE)
+
+//Row of padded Y, Z
+static inline int GetRowIndex(const int PaddedY, const int PaddedZ)
+{
+	return PaddedY + PaddedZ * VOX_PADDEDSIZE;
+}
+
+static inline bool IsPaddedInterior(const int PaddedPos)
+{
+	return PaddedPos > 0 && PaddedPos <= VOX_CHUNKSIZE;
+}
+
+//Occupancy bit rows of one visiblity type, bit of padded X in each row of padded (Y, Z)
+struct FVoxelOccupancyLayer
+{
+	int32 VisiblityType = 0;
+
+	//Blocks of this type in the whole padded volume, they occlude faces of this type
+	uint64 Solid[VOX_PADDEDROWS];
+
+	//Blocks of this type that have faces, only inside the chunk
+	uint64 Faces[VOX_PADDEDROWS];
+};
+
+//Row index offset to adjacent row, in EBlockFace order. X faces are bit shifts instead.
+static const int RowFaceOffsets[6] =
+{
+	0, 0,
+	-1, 1,
+	VOX_PADDEDSIZE, -VOX_PADDEDSIZE
+};
+
+//Fills render layers and the collision layer in one walk over the volume, either may be null
+static void BuildLayers(const FVoxelPaddedVolume& Volume, TArray<FVoxelOccupancyLayer>* RenderLayers, FVoxelOccupancyLayer* CollisionLayer)
+{
+	for (int PaddedZ = 0; PaddedZ < VOX_PADDEDSIZE; PaddedZ++)
+	{
+		for (int PaddedY = 0; PaddedY < VOX_PADDEDSIZE; PaddedY++)
+		{
+			const int Row = GetRowIndex(PaddedY, PaddedZ);
+			const bool bInteriorRow = IsPaddedInterior(PaddedY) && IsPaddedInterior(PaddedZ);
+
+			const uint32* RowIds = &Volume.BlockIds[Row * VOX_PADDEDSIZE];
+
+			for (int PaddedX = 0; PaddedX < VOX_PADDEDSIZE; PaddedX++)
+			{
+				const FVoxelBlockProperties& Properties = GetVoxelBlockProperties(RowIds[PaddedX]);
+				const uint64 Bit = 1ull << PaddedX;
+				const bool bInterior = bInteriorRow && IsPaddedInterior(PaddedX);
+
+				//Nothing to occlude with
+				if (!bInterior && !Volume.bBorderOccludes)
+				{
+					continue;
+				}
+
+				//Single layer, colliding blocks
+				if (CollisionLayer && Properties.bDoCollisions)
+				{
+					CollisionLayer->Solid[Row] |= Bit;
+
+					if (bInterior)
+					{
+						CollisionLayer->Faces[Row] |= Bit;
+					}
+				}
+
+				if (!RenderLayers)
+				{
+					continue;
+				}
+
+				TArray<FVoxelOccupancyLayer>& Layers = *RenderLayers;
+
+				int LayerIndex = 0;
+				while (LayerIndex < Layers.Num() && Layers[LayerIndex].VisiblityType != Properties.VisiblityType)
+				{
+					LayerIndex++;
+				}
+
+				if (LayerIndex == Layers.Num())
+				{
+					Layers.AddZeroed();
+					Layers[LayerIndex].VisiblityType = Properties.VisiblityType;
+				}
+
+				FVoxelOccupancyLayer& Layer = Layers[LayerIndex];
+
+				Layer.Solid[Row] |= Bit;
+
+				if (bInterior && Properties.bPolygonize)
+				{
+					Layer.Faces[Row] |= Bit;
+				}
+			}
+		}
+	}
+}
+
+//OutRows[Row] |= Faces[Row] & ~Occluders[Row + Offset], for rows with Z inside the chunk
+static void AndNotRows(const uint64* Faces, const uint64* Occluders, const int Offset, uint64* OutRows)
+{
+	const int Begin = GetRowIndex(0, 1);
+	const int End = GetRowIndex(0, VOX_CHUNKSIZE + 1);
+
+	int Row = Begin;
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS
+	//Two rows at once
+	for (; Row + 1 < End; Row += 2)
+	{
+		const VectorRegisterInt FacesVec = VectorIntLoad(&Faces[Row]);
+		const VectorRegisterInt OccludersVec = VectorIntLoad(&Occluders[Row + Offset]);
+		const VectorRegisterInt OutVec = VectorIntLoad(&OutRows[Row]);
+
+		VectorIntStore(VectorIntOr(OutVec, VectorIntAndNot(OccludersVec, FacesVec)), &OutRows[Row]);
+	}
+#endif
+
+	for (; Row < End; Row++)
+	{
+		OutRows[Row] |= Faces[Row] & ~Occluders[Row + Offset];
+	}
+}
+
+static void BuildFaceMasksFromLayers(const TArray<FVoxelOccupancyLayer>& Layers, FVoxelFaceMasks& OutMasks)
+{
+	//[Face * VOX_PADDEDROWS + Row], visible faces in padded bit rows
+	TArray<uint64> VisibleRows;
+	VisibleRows.SetNumZeroed(6 * VOX_PADDEDROWS);
+
+	for (const FVoxelOccupancyLayer& Layer : Layers)
+	{
+		uint64* Front = &VisibleRows[static_cast<uint8>(EBlockFace::FRONT) * VOX_PADDEDROWS];
+		uint64* Back = &VisibleRows[static_cast<uint8>(EBlockFace::BACK) * VOX_PADDEDROWS];
+
+		bool bHasFaces = false;
+
+		//X faces, adjacent voxel is the next bit of the same row
+		for (int Row = 0; Row < VOX_PADDEDROWS; Row++)
+		{
+			const uint64 Faces = Layer.Faces[Row];
+
+			Front[Row] |= Faces & ~(Layer.Solid[Row] >> 1);
+			Back[Row] |= Faces & ~(Layer.Solid[Row] << 1);
+
+			bHasFaces |= Faces != 0;
+		}
+
+		if (!bHasFaces)
+		{
+			continue;
+		}
+
+		for (const EBlockFace Face : { EBlockFace::LEFT, EBlockFace::RIGHT, EBlockFace::TOP, EBlockFace::BOTTOM })
+		{
+			const uint8 FaceNum = static_cast<uint8>(Face);
+			AndNotRows(Layer.Faces, Layer.Solid, RowFaceOffsets[FaceNum], &VisibleRows[FaceNum * VOX_PADDEDROWS]);
+		}
+	}
+
+	for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+	{
+		for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
+		{
+			for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+			{
+				const uint64 Row = VisibleRows[FaceNum * VOX_PADDEDROWS + GetRowIndex(Y + 1, Z + 1)];
+				OutMasks.Rows[FaceNum][Y + Z * VOX_CHUNKSIZE] = static_cast<uint32>(Row >> 1);
+			}
+		}
+	}
+}
+
+static void BuildFaceMasksReference(const FVoxelPaddedVolume& Volume, const bool bCollision, FVoxelFaceMasks& OutMasks)
+{
+	OutMasks.Reset();
+
+	for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
+	{
+		for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+		{
+			for (int X = 0; X < VOX_CHUNKSIZE; X++)
+			{
+				const int Index = FVoxelPaddedVolume::GetIndex(X, Y, Z);
+				UVoxelBlockDef* BlockDef = GetVoxelBlock(Volume.BlockIds[Index]);
+
+				if (bCollision ? !BlockDef->bDoCollisions : !BlockDef->ShouldBePolygonized())
+				{
+					continue;
+				}
+
+				for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+				{
+					const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+					UVoxelBlockDef* CheckBlockDef = GetVoxelBlock(Volume.BlockIds[Index + FVoxelPaddedVolume::GetFaceIndexOffset(Face)]);
+
+					const FIntVector CheckPos = FIntVector(X, Y, Z) + FVoxelUtilities::GetFaceOffset(Face);
+					const bool bIsBorder = !IsPaddedInterior(CheckPos.X + 1) || !IsPaddedInterior(CheckPos.Y + 1) || !IsPaddedInterior(CheckPos.Z + 1);
+
+					const bool bOcculdeThisFace = (!bIsBorder || Volume.bBorderOccludes) && (bCollision
+						? CheckBlockDef->bDoCollisions
+						: BlockDef->VisiblityType == CheckBlockDef->VisiblityType);
+
+					if (!bOcculdeThisFace)
+					{
+						OutMasks.Rows[FaceNum][Y + Z * VOX_CHUNKSIZE] |= 1u << X;
+					}
+				}
+			}
+		}
+	}
+}
+
+bool FVoxelFaceMasks::IsSliceEmpty(const EBlockFace Face, const int SliceNum) const
+{
+	const FIntVector Offset = FVoxelUtilities::GetFaceOffset(Face);
+	const uint32* FaceRows = Rows[static_cast<uint8>(Face)];
+
+	uint32 Result = 0;
+
+	if (Offset.X != 0)
+	{
+		for (int Row = 0; Row < VOX_CHUNKSIZE * VOX_CHUNKSIZE; Row++)
+		{
+			Result |= FaceRows[Row];
+		}
+		Result &= 1u << SliceNum;
+	}
+	else if (Offset.Y != 0)
+	{
+		for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
+		{
+			Result |= FaceRows[SliceNum + Z * VOX_CHUNKSIZE];
+		}
+	}
+	else
+	{
+		for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+		{
+			Result |= FaceRows[Y + SliceNum * VOX_CHUNKSIZE];
+		}
+	}
+
+	return Result == 0;
+}
+
+int FVoxelFaceMasks::CountFaces() const
+{
+	int Count = 0;
+
+	for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+	{
+		for (int Row = 0; Row < VOX_CHUNKSIZE * VOX_CHUNKSIZE; Row++)
+		{
+			Count += FPlatformMath::CountBits(Rows[FaceNum][Row]);
+		}
+	}
+
+	return Count;
+}
+
+void FVoxelFaceCulling::BuildRenderFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks)
+{
+	TArray<FVoxelOccupancyLayer> Layers;
+	BuildLayers(Volume, &Layers, nullptr);
+
+	BuildFaceMasksFromLayers(Layers, OutMasks);
+}
+
+void FVoxelFaceCulling::BuildCollisionFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks)
+{
+	TArray<FVoxelOccupancyLayer> CollisionLayers;
+	CollisionLayers.AddZeroed();
+	BuildLayers(Volume, nullptr, &CollisionLayers[0]);
+
+	BuildFaceMasksFromLayers(CollisionLayers, OutMasks);
+}
+
+void FVoxelFaceCulling::BuildFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutRenderMasks, FVoxelFaceMasks& OutCollisionMasks)
+{
+	TArray<FVoxelOccupancyLayer> Layers;
+	TArray<FVoxelOccupancyLayer> CollisionLayers;
+	CollisionLayers.AddZeroed();
+	BuildLayers(Volume, &Layers, &CollisionLayers[0]);
+
+	BuildFaceMasksFromLayers(Layers, OutRenderMasks);
+	BuildFaceMasksFromLayers(CollisionLayers, OutCollisionMasks);
+}
+
+void FVoxelFaceCulling::BuildUniformFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks* OutRenderMasks, FVoxelFaceMasks* OutCollisionMasks)
+{
+	const FVoxelBlockProperties& Properties = GetVoxelBlockProperties(Volume.BlockIds[FVoxelPaddedVolume::GetIndex(0, 0, 0)]);
+
+	//Block has no faces of that kind at all
+	FVoxelFaceMasks* RenderMasks = Properties.bPolygonize ? OutRenderMasks : nullptr;
+	FVoxelFaceMasks* CollisionMasks = Properties.bDoCollisions ? OutCollisionMasks : nullptr;
+
+	if (OutRenderMasks)
+	{
+		OutRenderMasks->Reset();
+	}
+	if (OutCollisionMasks)
+	{
+		OutCollisionMasks->Reset();
+	}
+
+	if (!RenderMasks && !CollisionMasks)
+	{
+		return;
+	}
+
+	for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
+	{
+		for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+		{
+			const bool bBorderRow = Y == 0 || Y == VOX_CHUNKSIZE - 1 || Z == 0 || Z == VOX_CHUNKSIZE - 1;
+
+			//Inner rows only have their two ends on the border
+			for (int X = 0; X < VOX_CHUNKSIZE; X += bBorderRow ? 1 : VOX_CHUNKSIZE - 1)
+			{
+				const int Index = FVoxelPaddedVolume::GetIndex(X, Y, Z);
+
+				for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+				{
+					const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+					const FIntVector AdjPos = FIntVector(X, Y, Z) + FVoxelUtilities::GetFaceOffset(Face);
+
+					//Same block inside the chunk, always occluded
+					if (IsPaddedInterior(AdjPos.X + 1) && IsPaddedInterior(AdjPos.Y + 1) && IsPaddedInterior(AdjPos.Z + 1))
+					{
+						continue;
+					}
+
+					const FVoxelBlockProperties& AdjProperties = GetVoxelBlockProperties(Volume.BlockIds[Index + FVoxelPaddedVolume::GetFaceIndexOffset(Face)]);
+
+					if (RenderMasks && (!Volume.bBorderOccludes || AdjProperties.VisiblityType != Properties.VisiblityType))
+					{
+						RenderMasks->Rows[FaceNum][Y + Z * VOX_CHUNKSIZE] |= 1u << X;
+					}
+
+					if (CollisionMasks && (!Volume.bBorderOccludes || !AdjProperties.bDoCollisions))
+					{
+						CollisionMasks->Rows[FaceNum][Y + Z * VOX_CHUNKSIZE] |= 1u << X;
+					}
+				}
+			}
+		}
+	}
+}
+
+void FVoxelFaceCulling::BuildRenderFaceMasksReference(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks)
+{
+	BuildFaceMasksReference(Volume, false, OutMasks);
+}
+
+void FVoxelFaceCulling::BuildCollisionFaceMasksReference(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks)
+{
+	BuildFaceMasksReference(Volume, true, OutMasks);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VoxelUtilities.h"
+
+#define VOX_PADDEDSIZE (VOX_CHUNKSIZE + 2)
+#define VOX_PADDEDARRAYSIZE (VOX_PADDEDSIZE * VOX_PADDEDSIZE * VOX_PADDEDSIZE)
+
+//Block ids of a chunk with one voxel of border gathered from its 6 face neighbors,
+//so the mesher can look at any adjacent voxel without bounds checks or locks
+struct FVoxelPaddedVolume
+{
+	TArray<uint32> BlockIds;
+
+	//False if the border is not known, faces on chunk border are never culled then
+	bool bBorderOccludes = true;
+
+	FVoxelPaddedVolume()
+	{
+		BlockIds.SetNumZeroed(VOX_PADDEDARRAYSIZE);
+	}
+
+	//Local position, -1 and VOX_CHUNKSIZE are the border
+	static inline int GetIndex(const int X, const int Y, const int Z)
+	{
+		return (X + 1)
+			+ ((Y + 1) * VOX_PADDEDSIZE)
+			+ ((Z + 1) * VOX_PADDEDSIZE * VOX_PADDEDSIZE);
+	}
+
+	static inline int GetIndex(const FIntVector& InVec)
+	{
+		return GetIndex(InVec.X, InVec.Y, InVec.Z);
+	}
+
+	//Index offset to the adjacent voxel on Face
+	static inline int GetFaceIndexOffset(const EBlockFace Face)
+	{
+		static const int Offsets[6] =
+		{
+			1, -1,
+			-VOX_PADDEDSIZE, VOX_PADDEDSIZE,
+			VOX_PADDEDSIZE * VOX_PADDEDSIZE, -VOX_PADDEDSIZE * VOX_PADDEDSIZE
+		};
+
+		return Offsets[static_cast<uint8>(Face)];
+	}
+};
+
+//Visible faces of a chunk, one bit per voxel and face
+struct FVoxelFaceMasks
+{
+	//[Face][Y + Z * VOX_CHUNKSIZE], bit X
+	uint32 Rows[6][VOX_CHUNKSIZE * VOX_CHUNKSIZE];
+
+	void Reset()
+	{
+		FMemory::Memzero(Rows);
+	}
+
+	inline bool IsFaceVisible(const EBlockFace Face, const int X, const int Y, const int Z) const
+	{
+		return (Rows[static_cast<uint8>(Face)][Y + Z * VOX_CHUNKSIZE] >> X) & 1;
+	}
+
+	inline bool IsFaceVisible(const EBlockFace Face, const FIntVector& LocalPos) const
+	{
+		return IsFaceVisible(Face, LocalPos.X, LocalPos.Y, LocalPos.Z);
+	}
+
+	//No visible face on the slice SliceNum along Face's axis?
+	bool IsSliceEmpty(const EBlockFace Face, const int SliceNum) const;
+
+	int CountFaces() const;
+
+	bool operator==(const FVoxelFaceMasks& Other) const
+	{
+		return FMemory::Memcmp(Rows, Other.Rows, sizeof(Rows)) == 0;
+	}
+};
+
+//Finds visible faces of a padded volume with bitwise operations over whole rows of voxels.
+//Every visibility type gets a bit row of occupancy per (Y, Z), so faces along X are found with shifts,
+//and faces along Y, Z with AND-NOT of adjacent rows, vectorized if the platform has vector intrinsics.
+class FVoxelFaceCulling
+{
+public:
+	//Faces of polygonized blocks whose adjacent block has different VisiblityType
+	static void BuildRenderFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks);
+
+	//Faces of colliding blocks whose adjacent block doesn't collide
+	static void BuildCollisionFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks);
+
+	//Both of above, reading the volume once
+	static void BuildFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutRenderMasks, FVoxelFaceMasks& OutCollisionMasks);
+
+	//Same as above when the chunk part of the volume is all one block, only faces on chunk border can be visible then.
+	//Only tests the border voxels against the neighbors, either mask may be null
+	static void BuildUniformFaceMasks(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks* OutRenderMasks, FVoxelFaceMasks* OutCollisionMasks);
+
+	//Per voxel and per face versions of above, slow, for tests
+	static void BuildRenderFaceMasksReference(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks);
+	static void BuildCollisionFaceMasksReference(const FVoxelPaddedVolume& Volume, FVoxelFaceMasks& OutMasks);
+};
@@ -0,0 +1,158 @@
+#include "VoxelJobScheduler.h"
+#include "VoxelChunk.h"
+
+//Half diagonal of a chunk in chunk units, widens view cones so chunks partially in view count
+static const float ChunkRadius = 0.87f;
+
+//Edits are always sorted before other jobs
+static const float EditPriorityOffset = -1000000.0f;
+
+void FVoxelJobScheduler::AddJob(UVoxelChunk* Chunk, EChunkWorkType WorkType, uint64 WorkId, bool bIsEdit)
+{
+	FVoxelChunkJob Job;
+	Job.Chunk = Chunk;
+	Job.WorkType = WorkType;
+	Job.WorkId = WorkId;
+	Job.bIsEdit = bIsEdit;
+
+	FScopeLock ScopeLock(&Lock);
+
+	Job.Priority = GetPriority(Job);
+	Jobs.HeapPush(Job);
+}
+
+bool FVoxelJobScheduler::PopJob(FVoxelChunkJob& OutJob)
+{
+	FScopeLock ScopeLock(&Lock);
+
+	if (Jobs.Num() == 0)
+	{
+		return false;
+	}
+
+	Jobs.HeapPop(OutJob, false);
+	return true;
+}
+
+void FVoxelJobScheduler::RemoveJobs(UVoxelChunk* Chunk, TArray<FVoxelChunkJob>& OutRemoved)
+{
+	FScopeLock ScopeLock(&Lock);
+
+	const int OldNum = OutRemoved.Num();
+
+	for (int Index = Jobs.Num() - 1; Index >= 0; Index--)
+	{
+		if (Jobs[Index].Chunk == Chunk)
+		{
+			OutRemoved.Add(Jobs[Index]);
+			Jobs.RemoveAtSwap(Index, 1, false);
+		}
+	}
+
+	if (OutRemoved.Num() != OldNum)
+	{
+		Jobs.Heapify();
+	}
+}
+
+void FVoxelJobScheduler::UpdateTrackerViews(const TArray<FVoxelTrackerView>& NewViews)
+{
+	FScopeLock ScopeLock(&Lock);
+
+	if (!HasViewChanged(NewViews))
+	{
+		return;
+	}
+
+	TrackerViews = NewViews;
+
+	for (FVoxelChunkJob& Job : Jobs)
+	{
+		Job.Priority = GetPriority(Job);
+	}
+
+	Jobs.Heapify();
+}
+
+void FVoxelJobScheduler::Reset()
+{
+	FScopeLock ScopeLock(&Lock);
+
+	Jobs.Empty();
+	TrackerViews.Empty();
+}
+
+int FVoxelJobScheduler::Num() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Jobs.Num();
+}
+
+float FVoxelJobScheduler::GetChunkPriority(const FIntVector& ChunkPos) const
+{
+	FScopeLock ScopeLock(&Lock);
+	return GetPriorityUnlocked(ChunkPos);
+}
+
+float FVoxelJobScheduler::GetPriority(const FVoxelChunkJob& Job) const
+{
+	const float Priority = GetPriorityUnlocked(Job.Chunk->ChunkPos);
+	return Job.bIsEdit ? Priority + EditPriorityOffset : Priority;
+}
+
+float FVoxelJobScheduler::GetPriorityUnlocked(const FIntVector& ChunkPos) const
+{
+	//Center of the chunk
+	const FVector ChunkLocation = FVector(ChunkPos) + FVector(0.5f);
+
+	float Best = MAX_flt;
+
+	for (const FVoxelTrackerView& View : TrackerViews)
+	{
+		const FVector ToChunk = ChunkLocation - View.Location;
+		const float Distance = ToChunk.Size();
+
+		bool bInView = Distance <= NearDistance;
+
+		if (!bInView)
+		{
+			//Cone test, widened by the angle the chunk covers
+			const float CosToChunk = FVector::DotProduct(ToChunk / Distance, View.Direction);
+			const float HalfAngle = FMath::Acos(View.CosHalfFOV) + FMath::Atan(ChunkRadius / Distance);
+
+			bInView = HalfAngle >= PI || CosToChunk >= FMath::Cos(HalfAngle);
+		}
+
+		Best = FMath::Min(Best, bInView ? Distance : Distance * OutOfViewPenalty);
+	}
+
+	//No tracker yet, closer to origin first
+	if (TrackerViews.Num() == 0)
+	{
+		Best = ChunkLocation.Size();
+	}
+
+	return Best;
+}
+
+bool FVoxelJobScheduler::HasViewChanged(const TArray<FVoxelTrackerView>& NewViews) const
+{
+	if (NewViews.Num() != TrackerViews.Num())
+	{
+		return true;
+	}
+
+	for (int Index = 0; Index < NewViews.Num(); Index++)
+	{
+		const FVoxelTrackerView& Old = TrackerViews[Index];
+		const FVoxelTrackerView& New = NewViews[Index];
+
+		//About 10 degrees
+		if (Old.ChunkPos != New.ChunkPos || FVector::DotProduct(Old.Direction, New.Direction) < 0.985f)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
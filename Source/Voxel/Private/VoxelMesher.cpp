@@ -2,182 +2,328 @@
 #include "VoxelWorld.h"
 #include "VoxelChunk.h"
 
-FVoxelMesher::FVoxelMesher(UVoxelWorld* InVoxelWorld)
+//Position with AxisValue on Axis, A on the first other axis and B on the second
+static inline FIntVector MakeAxisPos(const int Axis, const int AxisValue, const int A, const int B)
 {
-	VoxelWorld = InVoxelWorld;
+	return Axis == 0 ? FIntVector(AxisValue, A, B)
+		: Axis == 1 ? FIntVector(A, AxisValue, B)
+		: FIntVector(A, B, AxisValue);
+}
 
-	VoxelSize = VoxelWorld->VoxelSize;
+static inline int GetFaceAxis(const EBlockFace Face)
+{
+	const FIntVector Offset = FVoxelUtilities::GetFaceOffset(Face);
+	return Offset.X != 0 ? 0 : (Offset.Y != 0 ? 1 : 2);
 }
 
-void FVoxelMesher::DoMesh(UVoxelChunk* Chunk, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshData, const FVoxelMesherParameters& Params)
+static inline bool IsPositiveFace(const EBlockFace Face)
+{
+	const FIntVector Offset = FVoxelUtilities::GetFaceOffset(Face);
+	return Offset.X + Offset.Y + Offset.Z > 0;
+}
+
+static const FVector BoxVerts[8] =
+{
+	FVector(0, 1, 1),
+	FVector(1, 1, 1),
+	FVector(1, 0, 1),
+	FVector(0, 0, 1),
+	FVector(0, 1, 0),
+	FVector(1, 1, 0),
+	FVector(1, 0, 0),
+	FVector(0, 0, 0)
+};
+
+struct FVoxelFaceDef
+{
+	//Indices into BoxVerts, with texture coordinates (0, 0), (0, 1), (1, 1), (1, 0)
+	int Corners[4];
+
+	FVector TangentX;
+	FVector TangentZ;
+
+	//Axes that texture coordinates U and V run along
+	int UAxis;
+	int VAxis;
+};
+
+//In EBlockFace order
+static const FVoxelFaceDef FaceDefs[6] =
+{
+	//FRONT, Pos X
+	{ { 6, 2, 1, 5 }, FVector(0.0f, 1.0f, 0.0f), FVector(1.0f, 0.0f, 0.0f), 1, 2 },
+	//BACK, Neg X
+	{ { 4, 0, 3, 7 }, FVector(0.0f, -1.0f, 0.0f), FVector(-1.0f, 0.0f, 0.0f), 1, 2 },
+	//LEFT, Neg Y
+	{ { 7, 3, 2, 6 }, FVector(1.0f, 0.0f, 0.0f), FVector(0.0f, -1.0f, 0.0f), 0, 2 },
+	//RIGHT, Pos Y
+	{ { 5, 1, 0, 4 }, FVector(-1.0f, 0.0f, 0.0f), FVector(0.0f, 1.0f, 0.0f), 0, 2 },
+	//TOP, Pos Z
+	{ { 0, 1, 2, 3 }, FVector(0.0f, -1.0f, 0.0f), FVector(0.0f, 0.0f, 1.0f), 1, 0 },
+	//BOTTOM, Neg Z
+	{ { 7, 6, 5, 4 }, FVector(0.0f, 1.0f, 0.0f), FVector(0.0f, 0.0f, -1.0f), 1, 0 }
+};
+
+static const FVector2D CornerTexCoords[4] =
 {
-	auto AddFace = [](FVoxelMeshSection& Section, int X, int Y, int Z, float VoxelSize, FColor Color, EBlockFace Face)
+	FVector2D(0.0f, 0.0f),
+	FVector2D(0.0f, 1.0f),
+	FVector2D(1.0f, 1.0f),
+	FVector2D(1.0f, 0.0f)
+};
+
+//Adds a quad covering Size voxels from Origin, Size is 1 on the face's axis
+//Texture coordinates are tiled once per voxel
+static void AddQuad(FRuntimeMeshRenderableMeshData& MeshData, const FIntVector& Origin, const FIntVector& Size, const float VoxelSize, const FColor Color, const EBlockFace Face)
+{
+	const FVoxelFaceDef& FaceDef = FaceDefs[static_cast<uint8>(Face)];
+
+	const uint32 VertIndex = MeshData.Positions.Num();
+
+	const FVector OriginVec = FVector(Origin);
+	const FVector SizeVec = FVector(Size);
+
+	for (int Corner = 0; Corner < 4; Corner++)
 	{
-		auto& MeshData = Section.MeshData;
+		const FVector2D& TexCoord = CornerTexCoords[Corner];
 
-		const uint32 VertIndex = MeshData.Positions.Num();
+		MeshData.Positions.Add((OriginVec + BoxVerts[FaceDef.Corners[Corner]] * SizeVec) * VoxelSize);
+		MeshData.Tangents.Add(FaceDef.TangentZ, FaceDef.TangentX);
+		MeshData.Colors.Add(Color);
+		MeshData.TexCoords.Add(FVector2D(TexCoord.X * SizeVec[FaceDef.UAxis], TexCoord.Y * SizeVec[FaceDef.VAxis]));
+	}
 
-		// Generate verts
-		const FVector BoxVerts[8] =
-		{
-			FVector(0, 1, 1),
-			FVector(1, 1, 1),
-			FVector(1, 0, 1),
-			FVector(0, 0, 1),
-			FVector(0, 1, 0),
-			FVector(1, 1, 0),
-			FVector(1, 0, 0),
-			FVector(0, 0, 0)
-		};
+	MeshData.Triangles.AddTriangle(VertIndex + 0, VertIndex + 1, VertIndex + 3);
+	MeshData.Triangles.AddTriangle(VertIndex + 1, VertIndex + 2, VertIndex + 3);
+}
 
-		FVector TangentX, TangentY, TangentZ;
+//Corner of a quad on the voxel grid
+static inline FIntVector GetCornerPos(const FVoxelFaceDef& FaceDef, const int Corner, const FIntVector& Origin, const FIntVector& Size)
+{
+	const FVector CornerOffset = BoxVerts[FaceDef.Corners[Corner]] * FVector(Size);
+	return Origin + FIntVector(FMath::RoundToInt(CornerOffset.X), FMath::RoundToInt(CornerOffset.Y), FMath::RoundToInt(CornerOffset.Z));
+}
 
+//Same as AddQuad, but reuses vertices of VertexCache with same corner, section and color
+//Texture coordinates follow voxel grid instead of the quad, so adjacent quads agree on shared corners
+static void AddSharedQuad(FRuntimeMeshRenderableMeshData& MeshData, const FIntVector& Origin, const FIntVector& Size, const float VoxelSize, const int32 SectionIndex, const FColor Color, const EBlockFace Face, TMap<uint64, int32>& VertexCache)
+{
+	const FVoxelFaceDef& FaceDef = FaceDefs[static_cast<uint8>(Face)];
 
-		auto AddVertex = [&](const FVector& InPosition, const FVector& InTangentX, const FVector& InTangentZ, const FVector2D& InTexCoord)
-		{
-			MeshData.Positions.Add((InPosition + FVector(X, Y, Z)) * VoxelSize);
-			MeshData.Tangents.Add(InTangentZ, InTangentX);
-			MeshData.Colors.Add(Color);
-			MeshData.TexCoords.Add(InTexCoord);
-		};
+	//Direction texture coordinates run on the grid, from corner (0, 0) to (1, 0) and (0, 1)
+	const float SignU = BoxVerts[FaceDef.Corners[3]][FaceDef.UAxis] - BoxVerts[FaceDef.Corners[0]][FaceDef.UAxis];
+	const float SignV = BoxVerts[FaceDef.Corners[1]][FaceDef.VAxis] - BoxVerts[FaceDef.Corners[0]][FaceDef.VAxis];
 
-		auto AddTriangle = [&](const uint32 A, const uint32 B, const uint32 C)
-		{
-			MeshData.Triangles.AddTriangle(A + VertIndex, B + VertIndex, C + VertIndex);
-		};
+	uint32 Indices[4];
 
+	for (int Corner = 0; Corner < 4; Corner++)
+	{
+		const FIntVector CornerPos = GetCornerPos(FaceDef, Corner, Origin, Size);
 
-		switch (Face)
-		{
-		case EBlockFace::TOP:
-		{
-			// Pos Z
-			TangentZ = FVector(0.0f, 0.0f, 1.0f);
-			TangentX = FVector(0.0f, -1.0f, 0.0f);
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
-		}
-		case EBlockFace::BACK:
-		{
-			// Neg X
-			TangentZ = FVector(-1.0f, 0.0f, 0.0f);
-			TangentX = FVector(0.0f, -1.0f, 0.0f);
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
-		}
-		case EBlockFace::RIGHT:
-		{
-			// Pos Y
-			TangentZ = FVector(0.0f, 1.0f, 0.0f);
-			TangentX = FVector(-1.0f, 0.0f, 0.0f);
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
-		}
-		case EBlockFace::FRONT:
-		{
-			// Pos X
-			TangentZ = FVector(1.0f, 0.0f, 0.0f);
-			TangentX = FVector(0.0f, 1.0f, 0.0f);
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
-		}
-		case EBlockFace::LEFT:
-		{
-			// Neg Y
-			TangentZ = FVector(0.0f, -1.0f, 0.0f);
-			TangentX = FVector(1.0f, 0.0f, 0.0f);
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
-		}
-		case EBlockFace::BOTTOM:
+		//Corner index fits 16 bits, normal is the same for the whole slice
+		const uint64 Key = uint64(CornerPos.X + (CornerPos.Y + CornerPos.Z * (VOX_CHUNKSIZE + 1)) * (VOX_CHUNKSIZE + 1))
+			| (uint64(SectionIndex & 0xFFFF) << 16)
+			| (uint64(Color.DWColor()) << 32);
+
+		if (const int32* Find = VertexCache.Find(Key))
 		{
-			// Neg Z
-			TangentZ = FVector(0.0f, 0.0f, -1.0f);
-			TangentX = FVector(0.0f, 1.0f, 0.0f);
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
-		}
+			Indices[Corner] = *Find;
+			continue;
 		}
-		
-		AddTriangle(0, 1, 3);
-		AddTriangle(1, 2, 3);
-	};
 
-	auto BlockStorage = Chunk->GetBlockStorage();
+		Indices[Corner] = MeshData.Positions.Num();
+		VertexCache.Add(Key, Indices[Corner]);
+
+		MeshData.Positions.Add(FVector(CornerPos) * VoxelSize);
+		MeshData.Tangents.Add(FaceDef.TangentZ, FaceDef.TangentX);
+		MeshData.Colors.Add(Color);
+		MeshData.TexCoords.Add(FVector2D(SignU * CornerPos[FaceDef.UAxis], SignV * CornerPos[FaceDef.VAxis]));
+	}
+
+	MeshData.Triangles.AddTriangle(Indices[0], Indices[1], Indices[3]);
+	MeshData.Triangles.AddTriangle(Indices[1], Indices[2], Indices[3]);
+}
+
+//What a visible face looks like, faces with same key can be merged
+struct FVoxelFaceKey
+{
+	int32 SectionIndex = INDEX_NONE;
+	int32 VisiblityType = 0;
+	FColor Color;
+
+	bool IsValid() const
+	{
+		return SectionIndex != INDEX_NONE;
+	}
+
+	bool operator==(const FVoxelFaceKey& Other) const
+	{
+		return SectionIndex == Other.SectionIndex && VisiblityType == Other.VisiblityType && Color == Other.Color;
+	}
+};
+
+//Collision faces only need to know whether they exist
+struct FVoxelCollisionFaceKey
+{
+	bool bIsFace = false;
 
-	const FIntVector ChunkMinPos = Chunk->GetMinPos();
+	bool IsValid() const
+	{
+		return bIsFace;
+	}
 
-	for (int X = 0; X < VOX_CHUNKSIZE; X++)
+	bool operator==(const FVoxelCollisionFaceKey& Other) const
 	{
-		for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+		return bIsFace == Other.bIsFace;
+	}
+};
+
+//Merged quad waiting to be emitted. Quads are collected first, so every buffer is reserved once with its exact size.
+struct FVoxelPendingQuad
+{
+	FIntVector Origin;
+	FIntVector Size;
+	EBlockFace Face;
+
+	//Render only
+	int32 SectionIndex;
+	FColor Color;
+};
+
+//Downsamples the chunk part of Volume by Factor, written back at full resolution with every Factor^3 cell made of one block,
+//so the same culling and greedy merging make a few large quads out of each cell.
+//Cell is its most common polygonized block if at least half of it is polygonized, empty otherwise.
+//Border keeps the neighbor's blocks under a cell face only if they are all of one visibility type, so faces the neighbor fully occludes are culled.
+//Others stay even where the neighbor occludes them at full detail, the neighbor may be at other LOD, they close seams like skirts.
+static void DownsampleVolume(const FVoxelPaddedVolume& Volume, const FVoxelBlockStorage* BlockStorage, const int Factor, FVoxelPaddedVolume& OutVolume, TArray<FColor>& OutColors)
+{
+	FMemory::Memzero(OutVolume.BlockIds.GetData(), OutVolume.BlockIds.Num() * sizeof(uint32));
+	OutColors.SetNumUninitialized(VOX_ARRAYSIZE);
+
+	OutVolume.bBorderOccludes = Volume.bBorderOccludes;
+
+	for (int Axis = 0; Axis < 3 && Volume.bBorderOccludes; Axis++)
+	{
+		const int AxisU = (Axis + 1) % 3;
+		const int AxisV = (Axis + 2) % 3;
+
+		for (const int Side : { -1, VOX_CHUNKSIZE })
 		{
-			for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
+			for (int CellV = 0; CellV < VOX_CHUNKSIZE; CellV += Factor)
 			{
-				const FIntVector LocalPos = FIntVector(X, Y, Z);
+				for (int CellU = 0; CellU < VOX_CHUNKSIZE; CellU += Factor)
+				{
+					auto GetBorderIndex = [&](const int U, const int V)
+					{
+						FIntVector Pos;
+						Pos[Axis] = Side;
+						Pos[AxisU] = CellU + U;
+						Pos[AxisV] = CellV + V;
 
-				const FVoxelBlock& ThisBlock = BlockStorage->GetBlock(X, Y, Z);
-				UVoxelBlockDef* BlockDef = ThisBlock.GetBlock();
+						return FVoxelPaddedVolume::GetIndex(Pos);
+					};
 
-				if (BlockDef->ShouldBePolygonized())
-				{
-					auto& Section = MeshData->GetSectionFor(BlockDef);
+					const int VisiblityType = GetVoxelBlockProperties(Volume.BlockIds[GetBorderIndex(0, 0)]).VisiblityType;
 
-					for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+					bool bIsOneType = true;
+					for (int V = 0; V < Factor && bIsOneType; V++)
 					{
-						const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
-						const FIntVector CheckPos = LocalPos + FVoxelUtilities::GetFaceOffset(Face);
+						for (int U = 0; U < Factor && bIsOneType; U++)
+						{
+							bIsOneType = GetVoxelBlockProperties(Volume.BlockIds[GetBorderIndex(U, V)]).VisiblityType == VisiblityType;
+						}
+					}
 
-						bool bOcculdeThisFace = false;
+					if (!bIsOneType)
+					{
+						continue;
+					}
 
-						if (FVoxelUtilities::IsInLocalPosition(CheckPos.X, CheckPos.Y, CheckPos.Z))
+					for (int V = 0; V < Factor; V++)
+					{
+						for (int U = 0; U < Factor; U++)
 						{
-							const FVoxelBlock CheckBlock = BlockStorage->GetBlock(CheckPos.X, CheckPos.Y, CheckPos.Z);
-
-							bOcculdeThisFace = BlockDef->VisiblityType == CheckBlock.GetBlock()->VisiblityType;
-							
+							const int Index = GetBorderIndex(U, V);
+							OutVolume.BlockIds[Index] = Volume.BlockIds[Index];
 						}
-						else if (Params.bOcculdeFaceBorder)
-						{
-							const FIntVector CheckGlobalPos = ChunkMinPos + CheckPos;
+					}
+				}
+			}
+		}
+	}
 
-							const FIntVector AdjChunkPos = FVoxelUtilities::VoxelPosToChunkPos(CheckGlobalPos);
-							const FIntVector AdjChunkLocalPos = FVoxelUtilities::VoxelPosToLocalPos(CheckGlobalPos);
+	const int CellSize = Factor * Factor * Factor;
 
-							UVoxelChunk* AdjChunk = VoxelWorld->GetChunk(AdjChunkPos);
+	//Block id, count and first position in the cell
+	struct FCellCount
+	{
+		uint32 BlockId;
+		int Count;
+		FIntVector FirstPos;
+	};
+	TArray<FCellCount, TInlineAllocator<8>> Counts;
 
-							if (AdjChunk)
+	for (int CellZ = 0; CellZ < VOX_CHUNKSIZE; CellZ += Factor)
+	{
+		for (int CellY = 0; CellY < VOX_CHUNKSIZE; CellY += Factor)
+		{
+			for (int CellX = 0; CellX < VOX_CHUNKSIZE; CellX += Factor)
+			{
+				Counts.Reset();
+				int NumPolygonized = 0;
+
+				for (int Z = CellZ; Z < CellZ + Factor; Z++)
+				{
+					for (int Y = CellY; Y < CellY + Factor; Y++)
+					{
+						for (int X = CellX; X < CellX + Factor; X++)
+						{
+							const uint32 BlockId = Volume.BlockIds[FVoxelPaddedVolume::GetIndex(X, Y, Z)];
+
+							if (!GetVoxelBlockProperties(BlockId).bPolygonize)
 							{
-								const FVoxelBlock CheckBlock = AdjChunk->GetBlock(AdjChunkLocalPos.X, AdjChunkLocalPos.Y, AdjChunkLocalPos.Z);
+								continue;
+							}
 
-								bOcculdeThisFace = BlockDef->VisiblityType == CheckBlock.GetBlock()->VisiblityType;
+							NumPolygonized++;
+
+							FCellCount* Found = Counts.FindByPredicate([BlockId](const FCellCount& Count) { return Count.BlockId == BlockId; });
+							if (Found)
+							{
+								Found->Count++;
 							}
 							else
 							{
-								bOcculdeThisFace = true;
+								Counts.Add({ BlockId, 1, FIntVector(X, Y, Z) });
 							}
 						}
+					}
+				}
+
+				if (NumPolygonized * 2 < CellSize)
+				{
+					continue;
+				}
 
-						if (!bOcculdeThisFace)
+				const FCellCount* Best = &Counts[0];
+				for (const FCellCount& Count : Counts)
+				{
+					if (Count.Count > Best->Count)
+					{
+						Best = &Count;
+					}
+				}
+
+				const FColor Color = BlockStorage->GetColor(Best->FirstPos.X, Best->FirstPos.Y, Best->FirstPos.Z);
+
+				for (int Z = CellZ; Z < CellZ + Factor; Z++)
+				{
+					for (int Y = CellY; Y < CellY + Factor; Y++)
+					{
+						for (int X = CellX; X < CellX + Factor; X++)
 						{
-							AddFace(Section, X, Y, Z, VoxelSize, ThisBlock.Color, Face);
+							OutVolume.BlockIds[FVoxelPaddedVolume::GetIndex(X, Y, Z)] = Best->BlockId;
+							OutColors[FVoxelUtilities::GetArrayIndex(X, Y, Z)] = Color;
 						}
 					}
 				}
@@ -186,150 +332,542 @@ void FVoxelMesher::DoMesh(UVoxelChunk* Chunk, TSharedPtr<FVoxelMeshData, ESPMode
 	}
 }
 
-void FVoxelMesher::DoCollision(UVoxelChunk* Chunk, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> ColData)
+//Merges equal keys of a VOX_CHUNKSIZE^2 slice into maximal rectangles, consumes the slice
+template<typename KeyType, typename EmitType>
+static void GreedyMergeSlice(KeyType* Slice, EmitType&& Emit)
+{
+	for (int B = 0; B < VOX_CHUNKSIZE; B++)
+	{
+		for (int A = 0; A < VOX_CHUNKSIZE; )
+		{
+			const KeyType Key = Slice[A + B * VOX_CHUNKSIZE];
+
+			if (!Key.IsValid())
+			{
+				A++;
+				continue;
+			}
+
+			int Width = 1;
+			while (A + Width < VOX_CHUNKSIZE && Slice[A + Width + B * VOX_CHUNKSIZE] == Key)
+			{
+				Width++;
+			}
+
+			int Height = 1;
+			for (; B + Height < VOX_CHUNKSIZE; Height++)
+			{
+				bool bRowMatches = true;
+				for (int Offset = 0; Offset < Width; Offset++)
+				{
+					if (!(Slice[A + Offset + (B + Height) * VOX_CHUNKSIZE] == Key))
+					{
+						bRowMatches = false;
+						break;
+					}
+				}
+
+				if (!bRowMatches)
+				{
+					break;
+				}
+			}
+
+			for (int ClearB = B; ClearB < B + Height; ClearB++)
+			{
+				for (int ClearA = A; ClearA < A + Width; ClearA++)
+				{
+					Slice[ClearA + ClearB * VOX_CHUNKSIZE] = KeyType();
+				}
+			}
+
+			Emit(Key, A, B, Width, Height);
+
+			A += Width;
+		}
+	}
+}
+
+FVoxelMesher::FVoxelMesher(UVoxelWorld* InVoxelWorld)
+{
+	VoxelWorld = InVoxelWorld;
+
+	VoxelSize = VoxelWorld->VoxelSize;
+}
+
+bool FVoxelMesher::DoMesh(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshData, const FVoxelMesherParameters& Params)
+{
+	const FVoxelBlockStorage* BlockStorage = Snapshot.Storage.Get();
+
+	MeshData->StorageVersion = Snapshot.Version;
+	MeshData->bHasLOD0 = Params.bBuildLOD0;
+	MeshData->bHasLODs = Params.bBuildLODs;
+
+	const bool bIsUniform = BlockStorage->IsUniform();
+
+	if (bIsUniform && !GetVoxelBlockProperties(BlockStorage->GetUniformBlockId()).bPolygonize)
+	{
+		//All-air chunk, nothing to mesh
+		return true;
+	}
+
+	//Occlusion tests only need block ids, colors are read for emitted faces only
+	FVoxelPaddedVolume Volume;
+	GatherVolume(Chunk, Snapshot, Params.bOcculdeFaceBorder, Volume);
+
+	if (Params.bBuildLOD0)
+	{
+		FVoxelFaceMasks FaceMasks;
+
+		//Interior of uniform chunk is fully occluded, only its border is tested
+		if (bIsUniform)
+		{
+			FVoxelFaceCulling::BuildUniformFaceMasks(Volume, &FaceMasks, nullptr);
+		}
+		else
+		{
+			FVoxelFaceCulling::BuildRenderFaceMasks(Volume, FaceMasks);
+		}
+
+		if (!EmitMesh(Chunk, Snapshot, Volume, FaceMasks, *MeshData, Params))
+		{
+			return false;
+		}
+	}
+
+	return !Params.bBuildLODs || EmitLODs(Chunk, Snapshot, Volume, *MeshData, Params);
+}
+
+bool FVoxelMesher::DoCollision(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> ColData, const FVoxelMesherParameters& Params)
+{
+	const FVoxelBlockStorage* BlockStorage = Snapshot.Storage.Get();
+
+	const bool bIsUniform = BlockStorage->IsUniform();
+
+	if (bIsUniform && !GetVoxelBlockProperties(BlockStorage->GetUniformBlockId()).bDoCollisions)
+	{
+		return true;
+	}
+
+	FVoxelPaddedVolume Volume;
+	GatherVolume(Chunk, Snapshot, true, Volume);
+
+	FVoxelFaceMasks FaceMasks;
+
+	if (bIsUniform)
+	{
+		FVoxelFaceCulling::BuildUniformFaceMasks(Volume, nullptr, &FaceMasks);
+	}
+	else
+	{
+		FVoxelFaceCulling::BuildCollisionFaceMasks(Volume, FaceMasks);
+	}
+
+	return EmitCollision(Chunk, FaceMasks, *ColData, Params);
+}
+
+bool FVoxelMesher::DoMeshAndCollision(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshData, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> ColData, const FVoxelMesherParameters& Params)
 {
-	auto AddFace = [](FRuntimeMeshCollisionData& MeshData, int X, int Y, int Z, float VoxelSize, EBlockFace Face)
+	check(Params.bBuildLOD0);
+
+	//Render border would differ from collision's, no volume to share
+	if (!Params.bOcculdeFaceBorder)
+	{
+		return DoMesh(Chunk, Snapshot, MeshData, Params) && DoCollision(Chunk, Snapshot, ColData, Params);
+	}
+
+	const FVoxelBlockStorage* BlockStorage = Snapshot.Storage.Get();
+
+	MeshData->StorageVersion = Snapshot.Version;
+	MeshData->bHasLODs = Params.bBuildLODs;
+
+	const bool bIsUniform = BlockStorage->IsUniform();
+
+	if (bIsUniform)
 	{
-		const uint32 VertIndex = MeshData.Vertices.Num();
+		const FVoxelBlockProperties& Properties = GetVoxelBlockProperties(BlockStorage->GetUniformBlockId());
 
-		// Generate verts
-		const FVector BoxVerts[8] =
+		if (!Properties.bPolygonize && !Properties.bDoCollisions)
 		{
-			FVector(0, 1, 1),
-			FVector(1, 1, 1),
-			FVector(1, 0, 1),
-			FVector(0, 0, 1),
-			FVector(0, 1, 0),
-			FVector(1, 1, 0),
-			FVector(1, 0, 0),
-			FVector(0, 0, 0)
-		};
+			return true;
+		}
+	}
 
-		FVector TangentX, TangentY, TangentZ;
+	FVoxelPaddedVolume Volume;
+	GatherVolume(Chunk, Snapshot, true, Volume);
 
+	//Heap, two of them are 48KB
+	TUniquePtr<FVoxelFaceMasks> RenderMasks = MakeUnique<FVoxelFaceMasks>();
+	TUniquePtr<FVoxelFaceMasks> CollisionMasks = MakeUnique<FVoxelFaceMasks>();
 
-		auto AddVertex = [&](const FVector& InPosition, const FVector& InTangentX, const FVector& InTangentZ, const FVector2D& InTexCoord)
+	if (bIsUniform)
+	{
+		FVoxelFaceCulling::BuildUniformFaceMasks(Volume, RenderMasks.Get(), CollisionMasks.Get());
+	}
+	else
+	{
+		FVoxelFaceCulling::BuildFaceMasks(Volume, *RenderMasks, *CollisionMasks);
+	}
+
+	return EmitMesh(Chunk, Snapshot, Volume, *RenderMasks, *MeshData, Params)
+		&& (!Params.bBuildLODs || EmitLODs(Chunk, Snapshot, Volume, *MeshData, Params))
+		&& EmitCollision(Chunk, *CollisionMasks, *ColData, Params);
+}
+
+bool FVoxelMesher::EmitMesh(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, const FVoxelPaddedVolume& Volume, const FVoxelFaceMasks& FaceMasks, FVoxelMeshData& MeshData, const FVoxelMesherParameters& Params, const FColor* Colors)
+{
+	const FVoxelBlockStorage* BlockStorage = Snapshot.Storage.Get();
+
+	FVoxelFaceKey Slice[VOX_CHUNKSIZE * VOX_CHUNKSIZE];
+
+	TArray<FVoxelPendingQuad> Quads;
+
+	for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+	{
+		//Safe point, no need to finish if the chunk is gone
+		if (Chunk->IsDestroying())
 		{
-			MeshData.Vertices.Add((InPosition + FVector(X, Y, Z)) * VoxelSize);
-		};
+			return false;
+		}
 
-		auto AddTriangle = [&](const uint32 A, const uint32 B, const uint32 C)
+		const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+		const int Axis = GetFaceAxis(Face);
+
+		for (int SliceNum = 0; SliceNum < VOX_CHUNKSIZE; SliceNum++)
 		{
-			MeshData.Triangles.Add(A + VertIndex, B + VertIndex, C + VertIndex);
-		};
+			if (FaceMasks.IsSliceEmpty(Face, SliceNum))
+			{
+				continue;
+			}
+
+			for (int B = 0; B < VOX_CHUNKSIZE; B++)
+			{
+				for (int A = 0; A < VOX_CHUNKSIZE; A++)
+				{
+					const FIntVector LocalPos = MakeAxisPos(Axis, SliceNum, A, B);
+
+					FVoxelFaceKey& Key = Slice[A + B * VOX_CHUNKSIZE];
+					Key = FVoxelFaceKey();
+
+					if (!FaceMasks.IsFaceVisible(Face, LocalPos))
+					{
+						continue;
+					}
+
+					const uint32 BlockId = Volume.BlockIds[FVoxelPaddedVolume::GetIndex(LocalPos)];
+
+					Key.SectionIndex = MeshData.GetSectionIndexFor(BlockId);
+					Key.VisiblityType = GetVoxelBlockProperties(BlockId).VisiblityType;
+					Key.Color = Colors ? Colors[FVoxelUtilities::GetArrayIndex(LocalPos.X, LocalPos.Y, LocalPos.Z)] : BlockStorage->GetColor(LocalPos.X, LocalPos.Y, LocalPos.Z);
+				}
+			}
+
+			auto EmitQuad = [&](const FVoxelFaceKey& Key, const int A, const int B, const int Width, const int Height)
+			{
+				Quads.Add({ MakeAxisPos(Axis, SliceNum, A, B), MakeAxisPos(Axis, 1, Width, Height), Face, Key.SectionIndex, Key.Color });
+			};
+
+			if (Params.bGreedyMeshing)
+			{
+				GreedyMergeSlice(Slice, EmitQuad);
+			}
+			else
+			{
+				for (int B = 0; B < VOX_CHUNKSIZE; B++)
+				{
+					for (int A = 0; A < VOX_CHUNKSIZE; A++)
+					{
+						const FVoxelFaceKey& Key = Slice[A + B * VOX_CHUNKSIZE];
+
+						if (Key.IsValid())
+						{
+							EmitQuad(Key, A, B, 1, 1);
+						}
+					}
+				}
+			}
+		}
+	}
 
+	TArray<int32, TInlineAllocator<16>> SectionQuads;
+	SectionQuads.SetNumZeroed(MeshData.Sections.Num());
 
-		switch (Face)
+	for (const FVoxelPendingQuad& Quad : Quads)
+	{
+		SectionQuads[Quad.SectionIndex]++;
+	}
+
+	//Upper bound if vertices are shared
+	for (int SectionIndex = 0; SectionIndex < SectionQuads.Num(); SectionIndex++)
+	{
+		MeshData.Sections[SectionIndex].ReserveQuads(SectionQuads[SectionIndex]);
+	}
+
+	//Quads are in slice order, vertices are only shared in the same slice
+	TMap<uint64, int32> VertexCache;
+	int32 CachedSlice = INDEX_NONE;
+
+	for (const FVoxelPendingQuad& Quad : Quads)
+	{
+		FRuntimeMeshRenderableMeshData& SectionMeshData = MeshData.Sections[Quad.SectionIndex].MeshData;
+
+		if (!Params.bShareVertices)
 		{
-		case EBlockFace::TOP:
+			AddQuad(SectionMeshData, Quad.Origin, Quad.Size, VoxelSize, Quad.Color, Quad.Face);
+			continue;
+		}
+
+		const int32 Slice = static_cast<uint8>(Quad.Face) * VOX_CHUNKSIZE + Quad.Origin[GetFaceAxis(Quad.Face)];
+		if (Slice != CachedSlice)
 		{
-			// Pos Z
-			TangentZ = FVector(0.0f, 0.0f, 1.0f);
-			TangentX = FVector(0.0f, -1.0f, 0.0f);
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
+			VertexCache.Reset();
+			CachedSlice = Slice;
 		}
-		case EBlockFace::BACK:
+
+		AddSharedQuad(SectionMeshData, Quad.Origin, Quad.Size, VoxelSize, Quad.SectionIndex, Quad.Color, Quad.Face, VertexCache);
+	}
+
+	MeshData.NumQuadCorners = Quads.Num() * 4;
+	MeshData.NumVertices = 0;
+
+	for (const FVoxelMeshSection& Section : MeshData.Sections)
+	{
+		MeshData.NumVertices += Section.MeshData.Positions.Num();
+	}
+
+	return true;
+}
+
+bool FVoxelMesher::EmitLODs(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, const FVoxelPaddedVolume& Volume, FVoxelMeshData& MeshData, const FVoxelMesherParameters& Params)
+{
+	MeshData.LODs.SetNum(VoxelWorld->GetNumLODs() - 1);
+
+	if (MeshData.LODs.Num() == 0)
+	{
+		return true;
+	}
+
+	//Nothing visible at full detail, downsampled cells would only add skirts
+	if (MeshData.bHasLOD0 && MeshData.Sections.Num() == 0)
+	{
+		return true;
+	}
+
+	//Uniform chunk downsamples to itself, every LOD is its LOD 0 again. Built here if this work doesn't build LOD 0
+	if (Snapshot.Storage->IsUniform())
+	{
+		FVoxelMeshData& FirstLOD = MeshData.GetLOD(1);
+		FirstLOD.StorageVersion = Snapshot.Version;
+
+		if (MeshData.bHasLOD0)
 		{
-			// Neg X
-			TangentZ = FVector(-1.0f, 0.0f, 0.0f);
-			TangentX = FVector(0.0f, -1.0f, 0.0f);
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
+			FirstLOD.Sections = MeshData.Sections;
+			FirstLOD.SectionIndices = MeshData.SectionIndices;
 		}
-		case EBlockFace::RIGHT:
+		else
 		{
-			// Pos Y
-			TangentZ = FVector(0.0f, 1.0f, 0.0f);
-			TangentX = FVector(-1.0f, 0.0f, 0.0f);
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[0], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
+			TUniquePtr<FVoxelFaceMasks> FaceMasks = MakeUnique<FVoxelFaceMasks>();
+			FVoxelFaceCulling::BuildUniformFaceMasks(Volume, FaceMasks.Get(), nullptr);
+
+			if (!EmitMesh(Chunk, Snapshot, Volume, *FaceMasks, FirstLOD, Params))
+			{
+				return false;
+			}
 		}
-		case EBlockFace::FRONT:
+
+		for (int LODIndex = 2; LODIndex < MeshData.GetNumLODs(); LODIndex++)
 		{
-			// Pos X
-			TangentZ = FVector(1.0f, 0.0f, 0.0f);
-			TangentX = FVector(0.0f, 1.0f, 0.0f);
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[1], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
+			FVoxelMeshData& LODMeshData = MeshData.GetLOD(LODIndex);
+			LODMeshData.StorageVersion = Snapshot.Version;
+			LODMeshData.Sections = FirstLOD.Sections;
+			LODMeshData.SectionIndices = FirstLOD.SectionIndices;
 		}
-		case EBlockFace::LEFT:
+
+		return true;
+	}
+
+	//Downsampled cells are only fewer quads if merged
+	FVoxelMesherParameters LODParams = Params;
+	LODParams.bGreedyMeshing = true;
+
+	FVoxelPaddedVolume LODVolume;
+	TArray<FColor> LODColors;
+	TUniquePtr<FVoxelFaceMasks> LODMasks = MakeUnique<FVoxelFaceMasks>();
+
+	for (int LODIndex = 1; LODIndex < MeshData.GetNumLODs(); LODIndex++)
+	{
+		DownsampleVolume(Volume, Snapshot.Storage.Get(), 1 << LODIndex, LODVolume, LODColors);
+		FVoxelFaceCulling::BuildRenderFaceMasks(LODVolume, *LODMasks);
+
+		FVoxelMeshData& LODMeshData = MeshData.GetLOD(LODIndex);
+		LODMeshData.StorageVersion = Snapshot.Version;
+
+		if (!EmitMesh(Chunk, Snapshot, LODVolume, *LODMasks, LODMeshData, LODParams, LODColors.GetData()))
 		{
-			// Neg Y
-			TangentZ = FVector(0.0f, -1.0f, 0.0f);
-			TangentX = FVector(1.0f, 0.0f, 0.0f);
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[3], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[2], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
+			return false;
 		}
-		case EBlockFace::BOTTOM:
+	}
+
+	return true;
+}
+
+bool FVoxelMesher::EmitCollision(UVoxelChunk* Chunk, const FVoxelFaceMasks& FaceMasks, FRuntimeMeshCollisionData& MeshData, const FVoxelMesherParameters& Params)
+{
+	//Vertex index of each corner on the voxel grid, for welding
+	TMap<FIntVector, int32> VertexIndices;
+
+	auto AddVertex = [&](const FIntVector& GridPos) -> int32
+	{
+		if (Params.bWeldCollisionVertices)
 		{
-			// Neg Z
-			TangentZ = FVector(0.0f, 0.0f, -1.0f);
-			TangentX = FVector(0.0f, 1.0f, 0.0f);
-			AddVertex(BoxVerts[7], TangentX, TangentZ, FVector2D(0.0f, 0.0f));
-			AddVertex(BoxVerts[6], TangentX, TangentZ, FVector2D(0.0f, 1.0f));
-			AddVertex(BoxVerts[5], TangentX, TangentZ, FVector2D(1.0f, 1.0f));
-			AddVertex(BoxVerts[4], TangentX, TangentZ, FVector2D(1.0f, 0.0f));
-			break;
+			if (const int32* Find = VertexIndices.Find(GridPos))
+			{
+				return *Find;
+			}
 		}
+
+		const int32 VertIndex = MeshData.Vertices.Num();
+		MeshData.Vertices.Add(FVector(GridPos) * VoxelSize);
+
+		if (Params.bWeldCollisionVertices)
+		{
+			VertexIndices.Add(GridPos, VertIndex);
 		}
 
-		AddTriangle(0, 1, 3);
-		AddTriangle(1, 2, 3);
+		return VertIndex;
 	};
 
-	auto BlockStorage = Chunk->GetBlockStorage();
-	auto& MeshData = *ColData;
+	FVoxelCollisionFaceKey Slice[VOX_CHUNKSIZE * VOX_CHUNKSIZE];
+
+	TArray<FVoxelPendingQuad> Quads;
 
-	for (int X = 0; X < VOX_CHUNKSIZE; X++)
+	for (int FaceNum = 0; FaceNum < 6; FaceNum++)
 	{
-		for (int Y = 0; Y < VOX_CHUNKSIZE; Y++)
+		//Safe point, no need to finish if the chunk is gone
+		if (Chunk->IsDestroying())
 		{
-			for (int Z = 0; Z < VOX_CHUNKSIZE; Z++)
-			{
-				const FIntVector LocalPos = FIntVector(X, Y, Z);
-				const FVoxelBlock& ThisBlock = BlockStorage->GetBlock(X, Y, Z);
-				UVoxelBlockDef* BlockDef = ThisBlock.GetBlock();
+			return false;
+		}
 
-				if (BlockDef->bDoCollisions)
-				{
-					for (int FaceNum = 0; FaceNum < 6; FaceNum++)
-					{
-						const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
-						const FIntVector CheckPos = LocalPos + FVoxelUtilities::GetFaceOffset(Face);
+		const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+		const int Axis = GetFaceAxis(Face);
 
-						bool bOcculdeThisFace = false;
+		for (int SliceNum = 0; SliceNum < VOX_CHUNKSIZE; SliceNum++)
+		{
+			if (FaceMasks.IsSliceEmpty(Face, SliceNum))
+			{
+				continue;
+			}
 
-						if (FVoxelUtilities::IsInLocalPosition(CheckPos.X, CheckPos.Y, CheckPos.Z))
-						{
-							const FVoxelBlock& CheckBlock = BlockStorage->GetBlock(CheckPos.X, CheckPos.Y, CheckPos.Z);
+			for (int B = 0; B < VOX_CHUNKSIZE; B++)
+			{
+				for (int A = 0; A < VOX_CHUNKSIZE; A++)
+				{
+					//Collision does not care about color or material
+					Slice[A + B * VOX_CHUNKSIZE].bIsFace = FaceMasks.IsFaceVisible(Face, MakeAxisPos(Axis, SliceNum, A, B));
+				}
+			}
 
-							bOcculdeThisFace = CheckBlock.GetBlock()->bDoCollisions;
+			auto EmitQuad = [&](const FVoxelCollisionFaceKey& Key, const int A, const int B, const int Width, const int Height)
+			{
+				Quads.Add({ MakeAxisPos(Axis, SliceNum, A, B), MakeAxisPos(Axis, 1, Width, Height), Face, INDEX_NONE, FColor() });
+			};
 
-						}
+			if (Params.bMergeCollisionFaces)
+			{
+				GreedyMergeSlice(Slice, EmitQuad);
+			}
+			else
+			{
+				for (int B = 0; B < VOX_CHUNKSIZE; B++)
+				{
+					for (int A = 0; A < VOX_CHUNKSIZE; A++)
+					{
+						const FVoxelCollisionFaceKey& Key = Slice[A + B * VOX_CHUNKSIZE];
 
-						if (!bOcculdeThisFace)
+						if (Key.IsValid())
 						{
-							AddFace(MeshData, X, Y, Z, VoxelSize, Face);
+							EmitQuad(Key, A, B, 1, 1);
 						}
 					}
 				}
 			}
 		}
 	}
+
+	//Exact for triangles, upper bound for vertices if welded
+	MeshData.Vertices.Reserve(MeshData.Vertices.Num() + Quads.Num() * 4);
+	MeshData.Triangles.Reserve(MeshData.Triangles.Num() + Quads.Num() * 2);
+
+	if (Params.bWeldCollisionVertices)
+	{
+		VertexIndices.Reserve(Quads.Num() * 4);
+	}
+
+	for (const FVoxelPendingQuad& Quad : Quads)
+	{
+		const FVoxelFaceDef& FaceDef = FaceDefs[static_cast<uint8>(Quad.Face)];
+
+		int32 Indices[4];
+		for (int Corner = 0; Corner < 4; Corner++)
+		{
+			Indices[Corner] = AddVertex(GetCornerPos(FaceDef, Corner, Quad.Origin, Quad.Size));
+		}
+
+		MeshData.Triangles.Add(Indices[0], Indices[1], Indices[3]);
+		MeshData.Triangles.Add(Indices[1], Indices[2], Indices[3]);
+	}
+
+	return true;
+}
+
+void FVoxelMesher::GatherVolume(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, const bool bUseNeighbors, FVoxelPaddedVolume& Volume)
+{
+	Snapshot.Storage->GetBlockIds(&Volume.BlockIds[FVoxelPaddedVolume::GetIndex(0, 0, 0)], VOX_PADDEDSIZE, VOX_PADDEDSIZE * VOX_PADDEDSIZE);
+
+	Volume.bBorderOccludes = bUseNeighbors;
+
+	//Neighbors are not freed while in scope
+	FVoxelChunkMap::FReadScope ReadScope(VoxelWorld->GetChunkMap());
+
+	for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+	{
+		const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+
+		const int Axis = GetFaceAxis(Face);
+		const bool bPositive = IsPositiveFace(Face);
+
+		//Local position on Axis of border voxels, this chunk's voxels touching them, and adjacent chunk's voxels
+		const int BorderValue = bPositive ? VOX_CHUNKSIZE : -1;
+		const int InnerValue = bPositive ? VOX_CHUNKSIZE - 1 : 0;
+		const int AdjValue = bPositive ? 0 : VOX_CHUNKSIZE - 1;
+
+		UVoxelChunk* AdjChunk = bUseNeighbors ? Chunk->GetNeighbor(Face) : nullptr;
+
+		//Takes the lock of adjacent chunk once
+		const FVoxelStorageSnapshot AdjSnapshot = AdjChunk ? AdjChunk->GetSnapshot() : FVoxelStorageSnapshot();
+
+		for (int B = 0; B < VOX_CHUNKSIZE; B++)
+		{
+			for (int A = 0; A < VOX_CHUNKSIZE; A++)
+			{
+				uint32& BorderId = Volume.BlockIds[FVoxelPaddedVolume::GetIndex(MakeAxisPos(Axis, BorderValue, A, B))];
+
+				if (AdjSnapshot.IsValid())
+				{
+					const FIntVector AdjPos = MakeAxisPos(Axis, AdjValue, A, B);
+					BorderId = AdjSnapshot.Storage->GetBlockId(AdjPos.X, AdjPos.Y, AdjPos.Z);
+				}
+				else if (bUseNeighbors)
+				{
+					//No chunk there, border is occluded
+					BorderId = Volume.BlockIds[FVoxelPaddedVolume::GetIndex(MakeAxisPos(Axis, InnerValue, A, B))];
+				}
+				else
+				{
+					BorderId = 0;
+				}
+			}
+		}
+	}
 }
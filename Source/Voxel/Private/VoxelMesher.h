@@ -1,6 +1,8 @@
 #pragma once
 
 #include "VoxelUtilities.h"
+#include "VoxelBlockStorage.h"
+#include "VoxelFaceCulling.h"
 
 class UVoxelChunk;
 class UVoxelWorld;
@@ -12,6 +14,24 @@ struct FVoxelMesherParameters
 
 	//Should occulde non-visible faces in borders, referencing adjacent chunks?
 	bool bOcculdeFaceBorder = true;
+
+	//Merge coplanar faces with same section, color and visiblity type into rectangles
+	bool bGreedyMeshing = true;
+
+	//Faces of same section and color share vertices at common corners, texture coordinates are then aligned to voxel grid
+	bool bShareVertices = true;
+
+	//Merge coplanar collision faces into rectangles
+	bool bMergeCollisionFaces = true;
+
+	//Share collision vertices between faces at same position
+	bool bWeldCollisionVertices = true;
+
+	//Mesh LOD 0, off for the work building LODs of an edit mesh that is already uploaded
+	bool bBuildLOD0 = true;
+
+	//Mesh LOD 1 and further, edit works leave them to a later work so the edit shows up sooner
+	bool bBuildLODs = true;
 };
 
 class FVoxelMesher
@@ -23,7 +43,27 @@ class FVoxelMesher
 public:
 	FVoxelMesher(UVoxelWorld* InVoxelWorld);
 
-	void DoMesh(UVoxelChunk* Chunk, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshData, const FVoxelMesherParameters& Params);
+	//Snapshot is the chunk's storage to mesh, MeshData->StorageVersion will be set to its version
+	//Returns false if cancelled because the chunk is being destroyed, MeshData is incomplete then
+	bool DoMesh(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshData, const FVoxelMesherParameters& Params);
+
+	bool DoCollision(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> ColData, const FVoxelMesherParameters& Params);
+
+	//Both of above from one gathered volume and one culling pass. Always builds LOD 0
+	bool DoMeshAndCollision(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshData, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> ColData, const FVoxelMesherParameters& Params);
+
+	//Copies Snapshot into Volume, and its border from neighbor links of the chunk taking each of their locks once
+	//Border is empty and doesn't occlude if bUseNeighbors is false, and a copy of the chunk's own border voxels if there's no adjacent chunk
+	void GatherVolume(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, const bool bUseNeighbors, FVoxelPaddedVolume& Volume);
+
+private:
+	//Quads of visible faces, false if cancelled
+	//Colors - Per voxel of the chunk, used instead of storage's if set
+	bool EmitMesh(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, const FVoxelPaddedVolume& Volume, const FVoxelFaceMasks& FaceMasks, FVoxelMeshData& MeshData, const FVoxelMesherParameters& Params, const FColor* Colors = nullptr);
+
+	//Meshes LOD 1 and further into MeshData.LODs from the full detail volume, false if cancelled.
+	//They are empty if LOD 0 is, and same as LOD 0 for uniform chunks
+	bool EmitLODs(UVoxelChunk* Chunk, const FVoxelStorageSnapshot& Snapshot, const FVoxelPaddedVolume& Volume, FVoxelMeshData& MeshData, const FVoxelMesherParameters& Params);
 
-	void DoCollision(UVoxelChunk* Chunk, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> ColData);
+	bool EmitCollision(UVoxelChunk* Chunk, const FVoxelFaceMasks& FaceMasks, FRuntimeMeshCollisionData& MeshData, const FVoxelMesherParameters& Params);
 };
@@ -14,104 +14,204 @@ void UVoxelRMCProvider::InitVoxel(UVoxelWorld* inVoxelWorld)
 	VoxelWorld = inVoxelWorld;
 }
 
-TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> UVoxelRMCProvider::GetMeshDataPtr()
+void UVoxelRMCProvider::SubmitMeshData(TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData)
 {
-	FScopeLock Lock(&PropertySyncRoot);
-
-	if (!MeshDataPtrs[1].IsValid())
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> ReplacedMeshData;
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> ReplacedLODMeshData;
 	{
-		MeshDataPtrs[1] = MakeShareable(new FVoxelMeshData());
+		FScopeLock Lock(&PropertySyncRoot);
+
+		if (MeshData->bHasLODs)
+		{
+			ReplacedLODMeshData = MoveTemp(LODMeshDataPtrs[1]);
+			LODMeshDataPtrs[1] = MeshData;
+		}
+		if (MeshData->bHasLOD0)
+		{
+			ReplacedMeshData = MoveTemp(MeshDataPtrs[1]);
+			MeshDataPtrs[1] = MeshData;
+		}
+
+		MeshData = nullptr;
 	}
 
-	return MeshDataPtrs[1];
+	//Newer one replaced a result never uploaded
+	VoxelWorld->DiscardMeshData(MoveTemp(ReplacedMeshData));
+	VoxelWorld->DiscardMeshData(MoveTemp(ReplacedLODMeshData));
 }
 
-TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> UVoxelRMCProvider::GetCollisionDataPtr()
+void UVoxelRMCProvider::SubmitCollisionData(TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData)
 {
-	FScopeLock Lock(&PropertySyncRoot);
-
-	if (!CollisionDataPtrs[1].IsValid())
 	{
-		CollisionDataPtrs[1] = MakeShareable(new FRuntimeMeshCollisionData());
+		FScopeLock Lock(&PropertySyncRoot);
+		Swap(CollisionDataPtrs[1], CollisionData);
 	}
 
-	return CollisionDataPtrs[1];
+	VoxelWorld->DiscardCollisionData(MoveTemp(CollisionData));
 }
 
-void UVoxelRMCProvider::UpdateMesh()
+bool UVoxelRMCProvider::UpdateMesh()
 {
-	FScopeLock Lock(&PropertySyncRoot);
-
 	check(VoxelWorld);
-	check(MeshDataPtrs[1].IsValid());
 
-	MeshDataPtrs[0] = MeshDataPtrs[1];
-	MeshDataPtrs[1] = nullptr;
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> OldMeshData;
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> OldLODMeshData;
 
-	auto& MeshData = *MeshDataPtrs[0];
-	
-	if (MeshData.Sections.Num() < LastSections)
+	//Null if their part has nothing waiting, its sections stay as they are
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> NewMeshData;
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> NewLODMeshData;
 	{
-		for (int i = MeshData.Sections.Num(); i < LastSections; i++)
+		FScopeLock Lock(&PropertySyncRoot);
+
+		//Already uploaded with a newer result
+		if (!MeshDataPtrs[1].IsValid() && !LODMeshDataPtrs[1].IsValid())
 		{
-			RemoveSection(0, i);
+			return false;
+		}
+
+		if (MeshDataPtrs[1].IsValid())
+		{
+			OldMeshData = MoveTemp(MeshDataPtrs[0]);
+			MeshDataPtrs[0] = MoveTemp(MeshDataPtrs[1]);
+			NewMeshData = MeshDataPtrs[0];
+		}
+		if (LODMeshDataPtrs[1].IsValid())
+		{
+			OldLODMeshData = MoveTemp(LODMeshDataPtrs[0]);
+			LODMeshDataPtrs[0] = MoveTemp(LODMeshDataPtrs[1]);
+			NewLODMeshData = LODMeshDataPtrs[0];
 		}
 	}
 
-	for (int Index = 0; Index < MeshData.Sections.Num(); Index++)
+	//Previous mesh goes back to the pool once neither part uses it
+	VoxelWorld->DiscardMeshData(MoveTemp(OldMeshData));
+	VoxelWorld->DiscardMeshData(MoveTemp(OldLODMeshData));
+
+	//Section layout is only touched on game thread
+	if (NewMeshData.IsValid())
 	{
-		auto& Section = MeshData.Sections[Index];
+		VoxelWorld->AddVertexReuseStats(NewMeshData->NumQuadCorners, NewMeshData->NumVertices);
+	}
 
-		SetupMaterialSlot(Index, FName(FString::Printf(TEXT("VoxelSection-%d"), Index)), Section.Material);
+	for (int LODIndex = 0; LODIndex < NumLODs; LODIndex++)
+	{
+		FVoxelMeshData* MeshData = LODIndex == 0 ? NewMeshData.Get() : NewLODMeshData.Get();
 
-		FRuntimeMeshSectionProperties Properties;
-		Properties.bCastsShadow = false;
-		Properties.bIsVisible = true;
-		Properties.MaterialSlot = Index;
-		Properties.bWants32BitIndices = true;
-		Properties.UpdateFrequency = ERuntimeMeshUpdateFrequency::Infrequent;
+		if (!MeshData)
+		{
+			continue;
+		}
 
-		CreateSection(0, Index, Properties);
-	}
+		//Mesh of an all-air chunk has no LODs
+		const int NumSections = LODIndex < MeshData->GetNumLODs() ? MeshData->GetLOD(LODIndex).Sections.Num() : 0;
+
+		for (int i = NumSections; i < LastSections[LODIndex]; i++)
+		{
+			RemoveSection(LODIndex, i);
+		}
+
+		for (int Index = 0; Index < NumSections; Index++)
+		{
+			auto& Section = MeshData->GetLOD(LODIndex).Sections[Index];
+
+			//Section order differs between LODs, slots are by section key
+			const int MaterialSlot = GetVoxelBlockProperties(Section.BlockDef->TypeId).SectionKey;
+
+			SetupMaterialSlot(MaterialSlot, FName(FString::Printf(TEXT("VoxelSection-%d"), MaterialSlot)), Section.Material);
 
-	LastSections = MeshData.Sections.Num();
+			FRuntimeMeshSectionProperties Properties;
+			Properties.bCastsShadow = false;
+			Properties.bIsVisible = true;
+			Properties.MaterialSlot = MaterialSlot;
+			Properties.bWants32BitIndices = Section.bUses32BitIndices;
+			Properties.UpdateFrequency = ERuntimeMeshUpdateFrequency::Infrequent;
+
+			CreateSection(LODIndex, Index, Properties);
+		}
+
+		LastSections[LODIndex] = NumSections;
+	}
 
 	MarkAllLODsDirty();
+
+	return true;
 }
 
-void UVoxelRMCProvider::UpdateCollision()
+bool UVoxelRMCProvider::UpdateCollision()
 {
-	FScopeLock Lock(&PropertySyncRoot);
-
 	check(VoxelWorld);
-	check(CollisionDataPtrs[1].IsValid());
 
-	CollisionDataPtrs[0] = CollisionDataPtrs[1];
-	CollisionDataPtrs[1] = nullptr;
+	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> OldCollisionData;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		if (!CollisionDataPtrs[1].IsValid())
+		{
+			return false;
+		}
+
+		OldCollisionData = MoveTemp(CollisionDataPtrs[0]);
+		CollisionDataPtrs[0] = MoveTemp(CollisionDataPtrs[1]);
+
+		bHasCollisionMesh = CollisionDataPtrs[0]->Vertices.Num() != 0;
+	}
+
+	VoxelWorld->DiscardCollisionData(MoveTemp(OldCollisionData));
 
 	MarkCollisionDirty();
+
+	return true;
+}
+
+bool UVoxelRMCProvider::AreLODsOutdated() const
+{
+	FScopeLock Lock(&PropertySyncRoot);
+
+	if (NumLODs == 1 || !MeshDataPtrs[0].IsValid())
+	{
+		return false;
+	}
+
+	return !LODMeshDataPtrs[0].IsValid() || LODMeshDataPtrs[0]->StorageVersion < MeshDataPtrs[0]->StorageVersion;
 }
 
 void UVoxelRMCProvider::Initialize()
 {
 	FScopeLock Lock(&PropertySyncRoot);
 
-	FRuntimeMeshLODProperties LODProperties;
-	LODProperties.ScreenSize = 0.0f;
+	NumLODs = VoxelWorld->GetNumLODs();
+
+	TArray<FRuntimeMeshLODProperties> LODs;
+
+	for (int LODIndex = 0; LODIndex < NumLODs; LODIndex++)
+	{
+		FRuntimeMeshLODProperties LODProperties;
+
+		//LOD is used below its screen size. Bounds radius over distance, for 90 degrees FOV
+		LODProperties.ScreenSize = LODIndex == 0 ? 1.0f : 0.866f / FMath::Max(VoxelWorld->LODDistances[LODIndex - 1], 1.0f);
+
+		LODs.Add(LODProperties);
+	}
 
-	ConfigureLODs({ LODProperties });
+	ConfigureLODs(LODs);
 }
 
 bool UVoxelRMCProvider::GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FRuntimeMeshRenderableMeshData& MeshData)
 {
-	FScopeLock Lock(&PropertySyncRoot);
+	//Keeps the mesh alive after unlocking, UpdateMesh only pools it if nobody else holds it
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> CurrentMeshData;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		CurrentMeshData = LODIndex == 0 ? MeshDataPtrs[0] : LODMeshDataPtrs[0];
+	}
 
-	if (LODIndex != 0 || !MeshDataPtrs[0]->Sections.IsValidIndex(SectionId))
+	if (!CurrentMeshData.IsValid() || LODIndex >= CurrentMeshData->GetNumLODs() || !CurrentMeshData->GetLOD(LODIndex).Sections.IsValidIndex(SectionId))
 	{
 		return false;
 	}
 
-	MeshData = MeshDataPtrs[0]->Sections[SectionId].MeshData;
+	//Copied, the section stays as it is for later requests until a newer mesh replaces it
+	MeshData = CurrentMeshData->GetLOD(LODIndex).Sections[SectionId].MeshData;
 
 	return true;
 }
@@ -136,11 +236,19 @@ FRuntimeMeshCollisionSettings UVoxelRMCProvider::GetCollisionSettings()
 
 bool UVoxelRMCProvider::GetCollisionMesh(FRuntimeMeshCollisionData& CollisionData)
 {
-	FScopeLock Lock(&PropertySyncRoot);
+	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> CurrentCollisionData;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+		CurrentCollisionData = CollisionDataPtrs[0];
+	}
 
-	check(CollisionDataPtrs[0].IsValid());
+	if (!CurrentCollisionData.IsValid())
+	{
+		return false;
+	}
 
-	CollisionData = *CollisionDataPtrs[0];
+	//Copied, same as sections
+	CollisionData = *CurrentCollisionData;
 
 	return true;
 }
@@ -149,5 +257,5 @@ bool UVoxelRMCProvider::HasCollisionMesh()
 {
 	FScopeLock Lock(&PropertySyncRoot);
 
-	return CollisionDataPtrs[0]->Vertices.Num() != 0;
+	return bHasCollisionMesh;
 }
@@ -18,14 +18,26 @@ protected:
 	UPROPERTY()
 	UVoxelWorld* VoxelWorld;
 
-	//0 - Current mesh data used, 1 - Temporary mesh data
+	//0 - Current mesh data used, 1 - Finished mesh data waiting for UpdateMesh
 	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshDataPtrs[2];
 
-	//0 - Current collision data used, 1 - Temporary collision data
+	//Same for LOD 1 and further. Edit meshes have no LODs, the previous ones stay until the mesh with only LODs after them.
+	//Often the same mesh data as above
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> LODMeshDataPtrs[2];
+
+	//0 - Current collision data used, 1 - Finished collision data waiting for UpdateCollision
 	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> CollisionDataPtrs[2];
 
-	int LastSections = 0;
+	bool bHasCollisionMesh = false;
+
+	//Per LOD
+	int LastSections[VOX_MAXLODS] = {};
+
+	int NumLODs = 1;
 
+	//Guards pointers and flags above only, never held while copying or building mesh data.
+	//Current data is only read once uploaded, so RMC may ask for it again as often as it needs,
+	//e.g. when its proxy is recreated, and from several threads
 	mutable FCriticalSection PropertySyncRoot;
 
 public:
@@ -34,16 +46,19 @@ public:
 
 	void InitVoxel(UVoxelWorld* inVoxelWorld);
 
-	//Provide mesh data into here
-	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> GetMeshDataPtr();
+	//Finished buffers, uploaded by next UpdateMesh or UpdateCollision. Any thread
+	//Mesh data replaces the waiting one only in the LOD parts it has, see FVoxelMeshData::bHasLOD0
+	void SubmitMeshData(TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData);
+	void SubmitCollisionData(TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData);
 
-	//Provide mesh data into here
-	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> GetCollisionDataPtr();
+	//False if nothing was waiting
 
+	bool UpdateMesh();
 
-	void UpdateMesh();
+	bool UpdateCollision();
 
-	void UpdateCollision();
+	//Current LODs were made from older storage than current LOD 0, an edit mesh was uploaded after them. Game thread
+	bool AreLODsOutdated() const;
 
 	void Initialize() override;
 
@@ -0,0 +1,468 @@
+#include "VoxelRegionProvider.h"
+#include "VoxelWorld.h"
+#include "VoxelChunk.h"
+
+//Section of a member mesh, null if it has no faces there
+static FVoxelMeshSection* FindMemberSection(FVoxelMeshData* MeshData, const int LODIndex, const int SectionKey)
+{
+	if (!MeshData || LODIndex >= MeshData->GetNumLODs())
+	{
+		return nullptr;
+	}
+
+	FVoxelMeshData& LOD = MeshData->GetLOD(LODIndex);
+
+	if (!LOD.SectionIndices.IsValidIndex(SectionKey) || LOD.SectionIndices[SectionKey] == INDEX_NONE)
+	{
+		return nullptr;
+	}
+
+	FVoxelMeshSection& Section = LOD.Sections[LOD.SectionIndices[SectionKey]];
+
+	return Section.MeshData.Positions.Num() ? &Section : nullptr;
+}
+
+void UVoxelRegionProvider::InitRegion(UVoxelWorld* InVoxelWorld, const FIntVector& InRegionPos)
+{
+	VoxelWorld = InVoxelWorld;
+	RegionPos = InRegionPos;
+}
+
+void UVoxelRegionProvider::AddChunk(UVoxelChunk* Chunk)
+{
+	FScopeLock Lock(&PropertySyncRoot);
+
+	check(!Members.Contains(Chunk));
+
+	FVoxelRegionMember& Member = Members.Add(Chunk);
+
+	const FIntVector RegionMinPos = RegionPos * VoxelWorld->RegionSize * VOX_CHUNKSIZE;
+	Member.Offset = FVector(Chunk->GetMinPos() - RegionMinPos) * VoxelWorld->VoxelSize;
+}
+
+void UVoxelRegionProvider::RemoveChunk(UVoxelChunk* Chunk)
+{
+	//Its faces go away from every section it had
+	ReplaceChunkMesh(Chunk, nullptr, nullptr);
+	ReplaceChunkCollision(Chunk, nullptr);
+
+	FVoxelRegionMember Member;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		if (!Members.RemoveAndCopyValue(Chunk, Member))
+		{
+			return;
+		}
+	}
+
+	//Results never uploaded
+	VoxelWorld->DiscardMeshData(MoveTemp(Member.MeshDataPtrs[1]));
+	VoxelWorld->DiscardMeshData(MoveTemp(Member.LODMeshDataPtrs[1]));
+	VoxelWorld->DiscardCollisionData(MoveTemp(Member.CollisionDataPtrs[1]));
+}
+
+int UVoxelRegionProvider::GetNumChunks() const
+{
+	FScopeLock Lock(&PropertySyncRoot);
+
+	return Members.Num();
+}
+
+void UVoxelRegionProvider::SubmitMeshData(UVoxelChunk* Chunk, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData)
+{
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> ReplacedMeshData;
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> ReplacedLODMeshData;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		FVoxelRegionMember* Member = Members.Find(Chunk);
+		if (Member)
+		{
+			if (MeshData->bHasLODs)
+			{
+				ReplacedLODMeshData = MoveTemp(Member->LODMeshDataPtrs[1]);
+				Member->LODMeshDataPtrs[1] = MeshData;
+			}
+			if (MeshData->bHasLOD0)
+			{
+				ReplacedMeshData = MoveTemp(Member->MeshDataPtrs[1]);
+				Member->MeshDataPtrs[1] = MeshData;
+			}
+
+			MeshData = nullptr;
+		}
+	}
+
+	//Replaced results never uploaded, or chunk already left the region
+	VoxelWorld->DiscardMeshData(MoveTemp(MeshData));
+	VoxelWorld->DiscardMeshData(MoveTemp(ReplacedMeshData));
+	VoxelWorld->DiscardMeshData(MoveTemp(ReplacedLODMeshData));
+}
+
+void UVoxelRegionProvider::SubmitCollisionData(UVoxelChunk* Chunk, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData)
+{
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		FVoxelRegionMember* Member = Members.Find(Chunk);
+		if (Member)
+		{
+			Swap(Member->CollisionDataPtrs[1], CollisionData);
+		}
+	}
+
+	VoxelWorld->DiscardCollisionData(MoveTemp(CollisionData));
+}
+
+bool UVoxelRegionProvider::UpdateChunkMesh(UVoxelChunk* Chunk)
+{
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> NewMeshData;
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> NewLODMeshData;
+	bool bHasNewLOD0 = false;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		FVoxelRegionMember* Member = Members.Find(Chunk);
+		if (!Member || (!Member->MeshDataPtrs[1].IsValid() && !Member->LODMeshDataPtrs[1].IsValid()))
+		{
+			return false;
+		}
+
+		bHasNewLOD0 = Member->MeshDataPtrs[1].IsValid();
+
+		//Part with nothing waiting stays as it is
+		NewMeshData = bHasNewLOD0 ? MoveTemp(Member->MeshDataPtrs[1]) : Member->MeshDataPtrs[0];
+		NewLODMeshData = Member->LODMeshDataPtrs[1].IsValid() ? MoveTemp(Member->LODMeshDataPtrs[1]) : Member->LODMeshDataPtrs[0];
+	}
+
+	if (bHasNewLOD0)
+	{
+		VoxelWorld->AddVertexReuseStats(NewMeshData->NumQuadCorners, NewMeshData->NumVertices);
+	}
+
+	ReplaceChunkMesh(Chunk, MoveTemp(NewMeshData), MoveTemp(NewLODMeshData));
+
+	return true;
+}
+
+bool UVoxelRegionProvider::UpdateChunkCollision(UVoxelChunk* Chunk)
+{
+	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> NewCollisionData;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		FVoxelRegionMember* Member = Members.Find(Chunk);
+		if (!Member || !Member->CollisionDataPtrs[1].IsValid())
+		{
+			return false;
+		}
+
+		NewCollisionData = MoveTemp(Member->CollisionDataPtrs[1]);
+	}
+
+	ReplaceChunkCollision(Chunk, MoveTemp(NewCollisionData));
+
+	return true;
+}
+
+bool UVoxelRegionProvider::AreChunkLODsOutdated(UVoxelChunk* Chunk) const
+{
+	FScopeLock Lock(&PropertySyncRoot);
+
+	const FVoxelRegionMember* Member = Members.Find(Chunk);
+	if (NumLODs == 1 || !Member || !Member->MeshDataPtrs[0].IsValid())
+	{
+		return false;
+	}
+
+	return !Member->LODMeshDataPtrs[0].IsValid() || Member->LODMeshDataPtrs[0]->StorageVersion < Member->MeshDataPtrs[0]->StorageVersion;
+}
+
+void UVoxelRegionProvider::ReplaceChunkMesh(UVoxelChunk* Chunk, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& NewMeshData, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& NewLODMeshData)
+{
+	check(IsInGameThread());
+
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> OldMeshData;
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> OldLODMeshData;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		FVoxelRegionMember* Member = Members.Find(Chunk);
+		if (!Member)
+		{
+			VoxelWorld->DiscardMeshData(MoveTemp(NewMeshData));
+			VoxelWorld->DiscardMeshData(MoveTemp(NewLODMeshData));
+			return;
+		}
+
+		OldMeshData = MoveTemp(Member->MeshDataPtrs[0]);
+		Member->MeshDataPtrs[0] = NewMeshData;
+
+		OldLODMeshData = MoveTemp(Member->LODMeshDataPtrs[0]);
+		Member->LODMeshDataPtrs[0] = NewLODMeshData;
+	}
+
+	const int NumSectionKeys = FBlockRegistry::GetInstance_Ptr()->GetNumSectionKeys();
+
+	for (int LODIndex = 0; LODIndex < NumLODs; LODIndex++)
+	{
+		FVoxelMeshData* OldLOD = LODIndex == 0 ? OldMeshData.Get() : OldLODMeshData.Get();
+		FVoxelMeshData* NewLOD = LODIndex == 0 ? NewMeshData.Get() : NewLODMeshData.Get();
+
+		//Kept part, its sections are combined from the same meshes as before
+		if (OldLOD == NewLOD)
+		{
+			continue;
+		}
+
+		TArray<int32>& Refs = SectionRefs[LODIndex];
+		Refs.SetNumZeroed(NumSectionKeys);
+
+		for (int SectionKey = 0; SectionKey < NumSectionKeys; SectionKey++)
+		{
+			const FVoxelMeshSection* OldSection = FindMemberSection(OldLOD, LODIndex, SectionKey);
+			const FVoxelMeshSection* NewSection = FindMemberSection(NewLOD, LODIndex, SectionKey);
+
+			//Other sections are combined from the same meshes as before
+			if (!OldSection && !NewSection)
+			{
+				continue;
+			}
+
+			const int OldRefs = Refs[SectionKey];
+			Refs[SectionKey] += int(NewSection != nullptr) - int(OldSection != nullptr);
+
+			if (OldRefs == 0)
+			{
+				SetupMaterialSlot(SectionKey, FName(FString::Printf(TEXT("VoxelSection-%d"), SectionKey)), NewSection->Material);
+
+				FRuntimeMeshSectionProperties Properties;
+				Properties.bCastsShadow = false;
+				Properties.bIsVisible = true;
+				Properties.MaterialSlot = SectionKey;
+				//Members together easily pass 16-bit indices
+				Properties.bWants32BitIndices = true;
+				Properties.UpdateFrequency = ERuntimeMeshUpdateFrequency::Average;
+
+				CreateSection(LODIndex, SectionKey, Properties);
+			}
+			else if (Refs[SectionKey] == 0)
+			{
+				RemoveSection(LODIndex, SectionKey);
+			}
+			else
+			{
+				MarkSectionDirty(LODIndex, SectionKey);
+			}
+		}
+	}
+
+	//Sections being combined on other threads may still hold it, the pool only keeps it once they're done
+	VoxelWorld->DiscardMeshData(MoveTemp(OldMeshData));
+	VoxelWorld->DiscardMeshData(MoveTemp(OldLODMeshData));
+}
+
+void UVoxelRegionProvider::ReplaceChunkCollision(UVoxelChunk* Chunk, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& NewCollisionData)
+{
+	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> OldCollisionData;
+	bool bChanged = false;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		FVoxelRegionMember* Member = Members.Find(Chunk);
+		if (!Member)
+		{
+			VoxelWorld->DiscardCollisionData(MoveTemp(NewCollisionData));
+			return;
+		}
+
+		OldCollisionData = MoveTemp(Member->CollisionDataPtrs[0]);
+		Member->CollisionDataPtrs[0] = NewCollisionData;
+
+		const bool bHadCollision = OldCollisionData.IsValid() && OldCollisionData->Vertices.Num() != 0;
+		const bool bHasCollision = NewCollisionData.IsValid() && NewCollisionData->Vertices.Num() != 0;
+
+		NumCollisionMembers += int(bHasCollision) - int(bHadCollision);
+		bChanged = bHadCollision || bHasCollision;
+	}
+
+	VoxelWorld->DiscardCollisionData(MoveTemp(OldCollisionData));
+
+	//Recooks the whole region, collision of RMC is per component
+	if (bChanged)
+	{
+		MarkCollisionDirty();
+	}
+}
+
+void UVoxelRegionProvider::Initialize()
+{
+	FScopeLock Lock(&PropertySyncRoot);
+
+	NumLODs = VoxelWorld->GetNumLODs();
+
+	TArray<FRuntimeMeshLODProperties> LODs;
+
+	for (int LODIndex = 0; LODIndex < NumLODs; LODIndex++)
+	{
+		FRuntimeMeshLODProperties LODProperties;
+
+		//Same distances as chunk components, for bounds RegionSize times larger. Regions closer than their size are at full detail anyway
+		const float RegionSize = VoxelWorld->RegionSize;
+		LODProperties.ScreenSize = LODIndex == 0 ? 1.0f : 0.866f * RegionSize / FMath::Max(VoxelWorld->LODDistances[LODIndex - 1], RegionSize);
+
+		LODs.Add(LODProperties);
+	}
+
+	ConfigureLODs(LODs);
+}
+
+bool UVoxelRegionProvider::GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FRuntimeMeshRenderableMeshData& MeshData)
+{
+	//Keeps member meshes alive while combining, they are only read so copies stay valid for later requests
+	TArray<TPair<FVector, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>>> Sources;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		Sources.Reserve(Members.Num());
+
+		for (const auto& Pair : Members)
+		{
+			const auto& MemberMeshData = Pair.Value.GetMeshData(LODIndex);
+
+			if (FindMemberSection(MemberMeshData.Get(), LODIndex, SectionId))
+			{
+				Sources.Emplace(Pair.Value.Offset, MemberMeshData);
+			}
+		}
+	}
+
+	int32 NumVertices = 0;
+	int32 NumIndices = 0;
+
+	for (const auto& Source : Sources)
+	{
+		const FVoxelMeshSection* Section = FindMemberSection(Source.Value.Get(), LODIndex, SectionId);
+
+		NumVertices += Section->MeshData.Positions.Num();
+		NumIndices += Section->MeshData.Triangles.Num();
+	}
+
+	if (NumVertices == 0)
+	{
+		return false;
+	}
+
+	MeshData.Positions.Reserve(NumVertices);
+	MeshData.Tangents.Reserve(NumVertices);
+	MeshData.Colors.Reserve(NumVertices);
+	MeshData.TexCoords.Reserve(NumVertices);
+	MeshData.Triangles.Reserve(NumIndices);
+
+	for (const auto& Source : Sources)
+	{
+		const FRuntimeMeshRenderableMeshData& Member = FindMemberSection(Source.Value.Get(), LODIndex, SectionId)->MeshData;
+
+		const FVector& Offset = Source.Key;
+		const int32 BaseIndex = MeshData.Positions.Num();
+
+		for (int32 Index = 0; Index < Member.Positions.Num(); Index++)
+		{
+			MeshData.Positions.Add(Member.Positions.GetPosition(Index) + Offset);
+			MeshData.Tangents.Add(Member.Tangents.GetNormal(Index), Member.Tangents.GetTangent(Index));
+			MeshData.Colors.Add(Member.Colors.GetColor(Index));
+			MeshData.TexCoords.Add(Member.TexCoords.GetTexCoord(Index));
+		}
+
+		for (int32 Index = 0; Index < Member.Triangles.Num(); Index++)
+		{
+			MeshData.Triangles.Add(BaseIndex + Member.Triangles.GetVertexIndex(Index));
+		}
+	}
+
+	return true;
+}
+
+FBoxSphereBounds UVoxelRegionProvider::GetBounds()
+{
+	FBox Box = FBox(FVector(0), FVector(VoxelWorld->RegionSize * VOX_CHUNKSIZE * VoxelWorld->VoxelSize));
+	return FBoxSphereBounds(Box);
+}
+
+FRuntimeMeshCollisionSettings UVoxelRegionProvider::GetCollisionSettings()
+{
+	FRuntimeMeshCollisionSettings Settings;
+
+	Settings.bUseAsyncCooking = true;
+	Settings.bUseComplexAsSimple = true;
+
+	return Settings;
+}
+
+bool UVoxelRegionProvider::GetCollisionMesh(FRuntimeMeshCollisionData& CollisionData)
+{
+	TArray<TPair<FVector, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>>> Sources;
+	{
+		FScopeLock Lock(&PropertySyncRoot);
+
+		Sources.Reserve(Members.Num());
+
+		for (const auto& Pair : Members)
+		{
+			const auto& MemberCollision = Pair.Value.CollisionDataPtrs[0];
+
+			if (MemberCollision.IsValid() && MemberCollision->Vertices.Num() != 0)
+			{
+				Sources.Emplace(Pair.Value.Offset, MemberCollision);
+			}
+		}
+	}
+
+	if (Sources.Num() == 0)
+	{
+		return false;
+	}
+
+	int32 NumVertices = 0;
+	int32 NumTriangles = 0;
+
+	for (const auto& Source : Sources)
+	{
+		NumVertices += Source.Value->Vertices.Num();
+		NumTriangles += Source.Value->Triangles.Num();
+	}
+
+	CollisionData.Vertices.Reserve(NumVertices);
+	CollisionData.Triangles.Reserve(NumTriangles);
+
+	for (const auto& Source : Sources)
+	{
+		const FRuntimeMeshCollisionData& Member = *Source.Value;
+
+		const FVector& Offset = Source.Key;
+		const int32 BaseIndex = CollisionData.Vertices.Num();
+
+		for (int32 Index = 0; Index < Member.Vertices.Num(); Index++)
+		{
+			CollisionData.Vertices.Add(Member.Vertices.GetPosition(Index) + Offset);
+		}
+
+		for (int32 Index = 0; Index < Member.Triangles.Num(); Index++)
+		{
+			int32 A, B, C;
+			Member.Triangles.GetTriangleIndices(Index, A, B, C);
+
+			CollisionData.Triangles.Add(BaseIndex + A, BaseIndex + B, BaseIndex + C);
+		}
+	}
+
+	return true;
+}
+
+bool UVoxelRegionProvider::HasCollisionMesh()
+{
+	FScopeLock Lock(&PropertySyncRoot);
+
+	return NumCollisionMembers != 0;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RuntimeMeshProvider.h"
+#include "VoxelUtilities.h"
+
+#include "VoxelRegionProvider.generated.h"
+
+class UVoxelChunk;
+class UVoxelWorld;
+
+//Meshes of one chunk in a region
+struct FVoxelRegionMember
+{
+	//From region origin, in world units
+	FVector Offset = FVector::ZeroVector;
+
+	//0 - Current mesh data used, 1 - Finished mesh data waiting for UpdateChunkMesh
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> MeshDataPtrs[2];
+
+	//Same for LOD 1 and further, kept over edit meshes that have no LODs. Often the same mesh data as above
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> LODMeshDataPtrs[2];
+
+	//0 - Current collision data used, 1 - Finished collision data waiting for UpdateChunkCollision
+	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> CollisionDataPtrs[2];
+
+	//Current mesh data LODIndex is combined from
+	const TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>& GetMeshData(const int LODIndex) const
+	{
+		return LODIndex == 0 ? MeshDataPtrs[0] : LODMeshDataPtrs[0];
+	}
+};
+
+//Renders every batched chunk of a RegionSize^3 region with one component, one section per section key and LOD.
+//Chunk meshes are kept as they are, a section is combined from them when RMC asks for it,
+//so a changed chunk only rebuilds the sections it had or has, on RMC's thread.
+//RMC providers hand over whole sections, so every rebuild copies all members of the section again.
+//Collision is one mesh for the region, a member's collision change rebuilds and re-cooks all of it.
+UCLASS()
+class VOXEL_API UVoxelRegionProvider : public URuntimeMeshProvider
+{
+	GENERATED_BODY()
+
+protected:
+	UPROPERTY()
+	UVoxelWorld* VoxelWorld;
+
+	FIntVector RegionPos;
+
+	TMap<UVoxelChunk*, FVoxelRegionMember> Members;
+
+	//Members having a section, [LOD][Section key]. Game thread only
+	TArray<int32> SectionRefs[VOX_MAXLODS];
+
+	int NumLODs = 1;
+
+	//Members with collision faces
+	int NumCollisionMembers = 0;
+
+	//Guards Members and NumCollisionMembers only, never held while combining
+	mutable FCriticalSection PropertySyncRoot;
+
+public:
+	void InitRegion(UVoxelWorld* InVoxelWorld, const FIntVector& InRegionPos);
+
+	//Game thread
+
+	void AddChunk(UVoxelChunk* Chunk);
+
+	//Its faces are removed from the sections of the region
+	void RemoveChunk(UVoxelChunk* Chunk);
+
+	int GetNumChunks() const;
+
+	//Finished buffers of a member, uploaded by next UpdateChunkMesh or UpdateChunkCollision. Any thread
+	//Mesh data replaces the waiting one only in the LOD parts it has, see FVoxelMeshData::bHasLOD0
+	void SubmitMeshData(UVoxelChunk* Chunk, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData);
+	void SubmitCollisionData(UVoxelChunk* Chunk, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData);
+
+	//Game thread, false if nothing was waiting
+
+	bool UpdateChunkMesh(UVoxelChunk* Chunk);
+
+	bool UpdateChunkCollision(UVoxelChunk* Chunk);
+
+	//Current LODs of the member were made from older storage than its current LOD 0, an edit mesh was uploaded after them
+	bool AreChunkLODsOutdated(UVoxelChunk* Chunk) const;
+
+	void Initialize() override;
+
+	bool GetSectionMeshForLOD(int32 LODIndex, int32 SectionId, FRuntimeMeshRenderableMeshData& MeshData) override;
+
+	FBoxSphereBounds GetBounds() override;
+
+	FRuntimeMeshCollisionSettings GetCollisionSettings() override;
+
+	bool GetCollisionMesh(FRuntimeMeshCollisionData& CollisionData) override;
+
+	bool HasCollisionMesh() override;
+
+	bool IsThreadSafe() override
+	{
+		return true;
+	};
+
+private:
+	//Makes NewMeshData current mesh of Chunk for LOD 0 and NewLODMeshData for the others,
+	//and creates, removes or dirties sections of the LODs that changed
+	void ReplaceChunkMesh(UVoxelChunk* Chunk, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& NewMeshData, TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& NewLODMeshData);
+
+	void ReplaceChunkCollision(UVoxelChunk* Chunk, TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& NewCollisionData);
+};
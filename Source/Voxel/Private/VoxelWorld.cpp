@@ -1,10 +1,15 @@
 #include "VoxelWorld.h"
 #include "VoxelChunk.h"
 #include "VoxelRMCProvider.h"
+#include "VoxelRegionProvider.h"
 #include "VoxelWorldGenerator.h"
 #include "VoxelMesher.h"
 #include "RuntimeMeshActor.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "Camera/PlayerCameraManager.h"
 #include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
 
 UVoxelWorld::UVoxelWorld()
 {
@@ -29,6 +34,9 @@ void UVoxelWorld::CreateWorld(UWorld* InWorld)
 
     World = InWorld;
 
+    //Rendered chunks need all their neighbors loaded to be meshed
+    DestroyExtent = FMath::Max(DestroyExtent, 1.0f);
+
     if (!bActorPerMesh)
     {
         FActorSpawnParameters SpawnPara;
@@ -43,6 +51,35 @@ void UVoxelWorld::CreateWorld(UWorld* InWorld)
 
     BlockRegistryPtr = FBlockRegistry::GetInstance();
 
+    const float CreationDistance = RenderDistance + DestroyExtent;
+    const int MaxOffset = FMath::CeilToInt(CreationDistance);
+
+    SphereOffsets.Reset();
+
+    for (int X = -MaxOffset; X <= MaxOffset; X++)
+    {
+        for (int Y = -MaxOffset; Y <= MaxOffset; Y++)
+        {
+            for (int Z = -MaxOffset; Z <= MaxOffset; Z++)
+            {
+                const FIntVector Offset = FIntVector(X, Y, Z);
+                if (FVector(Offset).Size() <= CreationDistance)
+                {
+                    SphereOffsets.Add(Offset);
+                }
+            }
+        }
+    }
+
+    //Nearest chunks are created, and so queued, first
+    SphereOffsets.Sort([](const FIntVector& A, const FIntVector& B)
+    {
+        return FVector(A).SizeSquared() < FVector(B).SizeSquared();
+    });
+
+    ChunkPool.Reserve(ChunkPoolPreReserve);
+    BlockStoragePool.Reserve(ChunkPoolPreReserve);
+
     ThreadPool = FQueuedThreadPool::Allocate();
     ThreadPool->Create(8, 409600U, EThreadPriority::TPri_Normal);
 
@@ -53,14 +90,41 @@ void UVoxelWorld::DestroyWorld()
 {
     check(bIsWorldCreated);
 
+    //Abandons queued tickets and waits for running ones, before chunks are gone
+    ThreadPool->Destroy();
+    Scheduler.Reset();
+
     for (auto& Chunk : ChunksArray)
     {
-        delete Chunk;
+        //Providers and regions must not point to it anymore
+        Chunk->ReleaseMeshTargets(false);
+
+        ChunkPool.Delete(Chunk);
     }
 
+    //No worker left, free everything now
     Chunks.Empty();
+    Chunks.Reclaim([this](UVoxelChunk* Chunk)
+    {
+        ChunkPool.Delete(Chunk);
+    }, true);
+
     ChunksArray.Empty();
 
+    ActivationQueue.Empty();
+    ActiveChunks.Empty();
+    BatchCooldowns.Empty();
+
+    ChunkInterests.Empty();
+    for (auto& State : TrackerStates)
+    {
+        State.bHasInterest = false;
+    }
+
+    MeshDataPool.Empty();
+    CollisionDataPool.Empty();
+    StorageLayerPools.Empty();
+
     delete Mesher;
     Mesher = nullptr;
 
@@ -83,51 +147,144 @@ void UVoxelWorld::DestroyWorld()
     }
 
     MeshComponents.Empty();
+    FreeMeshComponents.Empty();
+    RegionComponents.Empty();
 
     BlockRegistryPtr = nullptr;
 
-    ThreadPool->Destroy();
-
     bIsWorldCreated = false;
 }
 
-void UVoxelWorld::Tick()
+FVoxelUpdateScope::~FVoxelUpdateScope()
+{
+    VoxelWorld->AddUpdateCycles(FPlatformTime::Cycles64() - StartCycles);
+}
+
+#if !UE_BUILD_SHIPPING
+static TAutoConsoleVariable<int32> CVarShowVoxelStats(
+    TEXT("voxel.ShowStats"),
+    0,
+    TEXT("Shows update budget, vertex reuse, mesh component and pool stats of voxel worlds on screen"),
+    ECVF_Default);
+#endif
+
+void UVoxelWorld::Tick(float DeltaTime)
 {
+#if !UE_BUILD_SHIPPING
     if (GEngine)
     {
-        GEngine->AddOnScreenDebugMessage(314159, 0, FColor::Emerald, FString::Printf(TEXT("Loaded chunks : %d, Jobs remaining : %d, Updates this tick : %d"), ChunksArray.Num(), JobsRemaining.GetValue(), UpdatesThisTick));
+        GEngine->AddOnScreenDebugMessage(314159, 0, FColor::Emerald, FString::Printf(TEXT("Loaded chunks : %d, Active chunks : %d, Jobs remaining : %d, Jobs cancelled : %d, Updates this tick : %d"), ChunksArray.Num(), ActiveChunks.Num(), JobsRemaining.GetValue(), CancelledJobs.GetValue(), UpdatesThisTick));
+
+        //More detailed ones on demand
+        if (CVarShowVoxelStats.GetValueOnGameThread())
+        {
+            GEngine->AddOnScreenDebugMessage(314161, 0, FColor::Emerald, FString::Printf(TEXT("Update time : %.2f / %.2f ms"), FPlatformTime::ToMilliseconds64(UpdateCyclesThisTick), FPlatformTime::ToMilliseconds64(UpdateBudgetCycles)));
+            GEngine->AddOnScreenDebugMessage(314162, 0, FColor::Emerald, FString::Printf(TEXT("Vertex reuse : %.2f last chunk, %.2f all chunks"), LastVertexReuseRatio, UploadedVertices ? static_cast<float>(UploadedQuadCorners) / UploadedVertices : 0.0f));
+            GEngine->AddOnScreenDebugMessage(314163, 0, FColor::Emerald, FString::Printf(TEXT("Mesh components : %d in use, %d of them regions"), MeshComponents.Num() - FreeMeshComponents.Num(), RegionComponents.Num()));
+            GEngine->AddOnScreenDebugMessage(314160, 0, FColor::Emerald, FString::Printf(TEXT("Chunk pool : %d / %d, High-water mark : %d, Storage pool : %d / %d, High-water mark : %d, Mesh buffers reused : %d / %d, Storage layers reused : %d / %d"), ChunkPool.GetNumUsed(), ChunkPool.GetCapacity(), ChunkPool.GetHighWaterMark(), BlockStoragePool.GetNumUsed(), BlockStoragePool.GetCapacity(), BlockStoragePool.GetHighWaterMark(), MeshDataPool.GetNumReused(), MeshDataPool.GetNumReused() + MeshDataPool.GetNumCreated(), StorageLayerPools.GetNumReused(), StorageLayerPools.GetNumReused() + StorageLayerPools.GetNumCreated()));
+        }
     }
+#endif
 
     UpdatesThisTick = 0;
+    UpdateCyclesThisTick = 0;
 
-    for (auto& Tracker : Trackers)
-    {
-        FVector Location = Tracker->GetActorLocation();
+    //Spare frame time goes to chunk updates, slow frames get less
+    SmoothedFrameTimeMs = FMath::Lerp(SmoothedFrameTimeMs, DeltaTime * 1000.0f, 0.1f);
 
-        FIntVector VoxelPos = ToVoxelPos(Location);
-        FIntVector ChunkPos = FVoxelUtilities::VoxelPosToChunkPos(VoxelPos);
+    const float BudgetMs = FMath::Clamp(UpdateBudgetMs + (TargetFrameTimeMs - SmoothedFrameTimeMs) * 0.5f, MinUpdateBudgetMs, MaxUpdateBudgetMs);
+    UpdateBudgetCycles = static_cast<uint64>(BudgetMs / 1000.0 / FPlatformTime::GetSecondsPerCycle64());
 
-        float CreationDistance = RenderDistance + DestroyExtent;
+    //Interest only changes when a tracker crosses a chunk boundary
+    for (int Index = Trackers.Num() - 1; Index >= 0; Index--)
+    {
+        AActor* Tracker = Trackers[Index];
+        FVoxelTrackerState& State = TrackerStates[Index];
 
-        for (int X = ChunkPos.X - CreationDistance; X <= ChunkPos.X + CreationDistance; X++)
+        if (!IsValid(Tracker))
         {
-            for (int Y = ChunkPos.Y - CreationDistance; Y <= ChunkPos.Y + CreationDistance; Y++)
+            if (State.bHasInterest)
             {
-                for (int Z = ChunkPos.Z - CreationDistance; Z <= ChunkPos.Z + CreationDistance; Z++)
-                {
-                    FIntVector NewChunk = FIntVector(X, Y, Z);
-                    if (GetMinDistanceToTrackers(NewChunk) <= CreationDistance)
-                    {
-                        GetChunk(NewChunk, true);
-                    }
-                }
+                MoveTrackerInterest(&State.ChunkPos, nullptr);
             }
+
+            Trackers.RemoveAt(Index);
+            TrackerStates.RemoveAt(Index);
+            continue;
+        }
+
+        const FIntVector ChunkPos = FVoxelUtilities::VoxelPosToChunkPos(ToVoxelPos(Tracker->GetActorLocation()));
+
+        if (State.bHasInterest && State.ChunkPos == ChunkPos)
+        {
+            continue;
         }
-        //GetChunk(ChunkPos, true);
+
+        MoveTrackerInterest(State.bHasInterest ? &State.ChunkPos : nullptr, &ChunkPos);
+
+        State.ChunkPos = ChunkPos;
+        State.bHasInterest = true;
     }
 
-    for (auto& Chunk : ChunksArray)
+    UpdateTrackerViews();
+
+    //Idle chunks are not ticked, edited chunks are woken up to be batched again
+    const double Now = FPlatformTime::Seconds();
+
+    while (BatchCooldowns.Num() && BatchCooldowns.HeapTop().ExpireTime <= Now)
+    {
+        FVoxelBatchCooldown Cooldown;
+        BatchCooldowns.HeapPop(Cooldown, false);
+
+        UVoxelChunk* Chunk = GetChunk(Cooldown.ChunkPos);
+        if (!Chunk)
+        {
+            continue;
+        }
+
+        //Edited again since, wait for the new cooldown
+        if (IsInBatchCooldown(Chunk))
+        {
+            BatchCooldowns.HeapPush({ Chunk->GetLastEditTime() + BatchEditCooldown, Chunk->ChunkPos });
+            continue;
+        }
+
+        ActivateChunk(Chunk);
+    }
+
+    //Only chunks with something to do, activations made while ticking go to next frame
+    ActiveChunks.Reset();
+
+    UVoxelChunk* ActivatedChunk;
+    while (ActivationQueue.Dequeue(ActivatedChunk))
+    {
+        ActiveChunks.Add(ActivatedChunk);
+    }
+
+    //Nearest first, what doesn't fit in the budget stays active for next frame
+    TArray<TPair<float, UVoxelChunk*>> SortedChunks;
+    SortedChunks.Reserve(ActiveChunks.Num());
+
+    for (auto& Chunk : ActiveChunks)
+    {
+        SortedChunks.Emplace(Scheduler.GetChunkPriority(Chunk->ChunkPos), Chunk);
+    }
+
+    SortedChunks.Sort([](const TPair<float, UVoxelChunk*>& A, const TPair<float, UVoxelChunk*>& B)
+    {
+        return A.Key < B.Key;
+    });
+
+    for (int Index = 0; Index < SortedChunks.Num(); Index++)
     {
+        ActiveChunks[Index] = SortedChunks[Index].Value;
+    }
+
+    for (auto& Chunk : ActiveChunks)
+    {
+        //Cleared first, so the chunk can activate itself again
+        Chunk->bIsActive = false;
+
         if (Chunk->GetChunkState() == EChunkState::Destroyed)
         {
             continue;
@@ -143,7 +300,15 @@ void UVoxelWorld::Tick()
     {
         if (Chunk->IsReadyForFinishDestroy())
         {
+            const FIntVector ChunkPos = Chunk->ChunkPos;
+
             FinalizeDestroyChunk(Chunk);
+
+            //Came back in range while being destroyed
+            if (ChunkInterests.Contains(ChunkPos))
+            {
+                GetChunk(ChunkPos, true);
+            }
         }
         else
         {
@@ -152,38 +317,58 @@ void UVoxelWorld::Tick()
     }
 
     ToDestroy = NewToDestroy;
+
+    Chunks.Reclaim([this](UVoxelChunk* Chunk)
+    {
+        ChunkPool.Delete(Chunk);
+    });
 }
 
 void UVoxelWorld::RegisterTracker(AActor* Actor)
 {
-    Trackers.AddUnique(Actor);
+    if (!Trackers.Contains(Actor))
+    {
+        Trackers.Add(Actor);
+        TrackerStates.AddDefaulted();
+    }
 }
 
-void UVoxelWorld::QueueChunkWork(UVoxelChunk* Chunk, EChunkWorkType Type)
+void UVoxelWorld::QueueChunkWork(UVoxelChunk* Chunk, EChunkWorkType Type, bool bIsEdit)
 {
     FChunkWork& Work = Chunk->GetChunkWork(Type);
 
-    if (Work.bIsWorkOnline)
+    //May be called from worker threads. Counted before checking IsDestroying,
+    //so a chunk is never finalized with a work queued after its destruction.
+    Chunk->RemainingWorks.Increment();
+
+    if (Chunk->IsDestroying())
     {
+        Chunk->RemainingWorks.Decrement();
         return;
     }
 
-    Chunk->RemainingWorks.Increment();
+    if (Work.bIsWorkOnline.AtomicSet(true))
+    {
+        //Chunk queues it again once the running one is done, see UVoxelChunk::Tick
+        Work.bIsRerunRequested = true;
+        ActivateChunk(Chunk);
+
+        Chunk->RemainingWorks.Decrement();
+        return;
+    }
 
-    Work.bIsDelaying = false;
-    Work.bIsWorkOnline = true;
     Work.bIsDone = false;
+    Work.bIsEdit = bIsEdit;
 
     if (bAsync)
     {
-        static int64 UniqueWorkId = 1;
+        const int64 WorkId = NextWorkId.Increment();
 
-        Work.CurrentWorkId = UniqueWorkId;
+        Work.CurrentWorkId.Set(WorkId);
 
         JobsRemaining.Increment();
-        ThreadPool->AddQueuedWork(new FQueuedChunkWork(Chunk, Type, UniqueWorkId));
-        
-        UniqueWorkId++;
+        Scheduler.AddJob(Chunk, Type, WorkId, bIsEdit);
+        ThreadPool->AddQueuedWork(new FQueuedChunkWork(this));
     }
     else
     {
@@ -204,6 +389,11 @@ void UVoxelWorld::QueueChunkWork(UVoxelChunk* Chunk, EChunkWorkType Type)
             Chunk->PolygonizeChunk();
             break;
         }
+        case EChunkWorkType::MeshAndCollision:
+        {
+            Chunk->PolygonizeAndBuildCollision();
+            break;
+        }
         }
 
         Work.bIsWorkOnline = false;
@@ -216,38 +406,111 @@ void UVoxelWorld::QueueChunkWork(UVoxelChunk* Chunk, EChunkWorkType Type)
 
 UVoxelChunk* UVoxelWorld::NewChunk(const FIntVector& ChunkPos)
 {
-    check(!Chunks.Contains(ChunkPos));
+    check(!Chunks.Find(ChunkPos));
 
-    UVoxelChunk* NewChunk = new UVoxelChunk(this, ChunkPos);
+    UVoxelChunk* NewChunk = ChunkPool.New(this, ChunkPos);
 
     Chunks.Add(ChunkPos, NewChunk);
     ChunksArray.Add(NewChunk);
 
+    //Link both ways, chunk is fully constructed before others can reach it
+    for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+    {
+        const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+
+        UVoxelChunk* Neighbor = Chunks.Find(ChunkPos + FVoxelUtilities::GetFaceOffset(Face));
+        if (Neighbor)
+        {
+            NewChunk->SetNeighbor(Face, Neighbor);
+            Neighbor->SetNeighbor(FVoxelUtilities::GetOppositeFace(Face), NewChunk);
+
+            //Generated before we were linked. If it finishes right now, both sides may report it, that's fine.
+            if (Neighbor->IsGenerated())
+            {
+                NewChunk->SatisfyMeshDependency(1 << FaceNum);
+            }
+        }
+    }
+
+    ActivateChunk(NewChunk);
+
     return NewChunk;
 }
 
-UVoxelChunk* UVoxelWorld::GetChunk(const FIntVector& ChunkPos, const bool bCreateIfNotExists)
+void UVoxelWorld::ActivateChunk(UVoxelChunk* Chunk)
+{
+    if (!Chunk->bIsActive.AtomicSet(true))
+    {
+        ActivationQueue.Enqueue(Chunk);
+    }
+}
+
+TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> UVoxelWorld::AllocateMeshData()
+{
+    auto MeshData = MeshDataPool.Acquire();
+    MeshData->Reset();
+
+    return MeshData;
+}
+
+TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> UVoxelWorld::AllocateCollisionData()
 {
-    FRWScopeLock sl(ChunksLock, FRWScopeLockType::SLT_ReadOnly);
+    auto CollisionData = CollisionDataPool.Acquire();
 
-    UVoxelChunk** Find = Chunks.Find(ChunkPos);
+    //Only these are written by the mesher, keep their capacity
+    CollisionData->Vertices.SetNum(0, false);
+    CollisionData->Triangles.SetNum(0, false);
 
-    if (!Find && bCreateIfNotExists)
+    return CollisionData;
+}
+
+void UVoxelWorld::DiscardMeshData(TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData)
+{
+    MeshDataPool.Release(MoveTemp(MeshData));
+}
+
+void UVoxelWorld::DiscardCollisionData(TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData)
+{
+    CollisionDataPool.Release(MoveTemp(CollisionData));
+}
+
+TSharedPtr<FVoxelBlockStorage, ESPMode::ThreadSafe> UVoxelWorld::NewBlockStorage(const FVoxelBlockStorage* CopyFrom)
+{
+    FVoxelBlockStorage* Storage = CopyFrom ? BlockStoragePool.New(*CopyFrom) : BlockStoragePool.New(&StorageLayerPools);
+
+    //Last reference may be dropped on any thread, pool is thread safe
+    TVoxelSlabPool<FVoxelBlockStorage>* Pool = &BlockStoragePool;
+
+    return MakeShareable(Storage, [Pool](FVoxelBlockStorage* Obj)
     {
-        sl.ReleaseReadOnlyLockAndAcquireWriteLock_USE_WITH_CAUTION();
-        return NewChunk(ChunkPos);
-    }
+        Pool->Delete(Obj);
+    });
+}
+
+UVoxelChunk* UVoxelWorld::GetChunk(const FIntVector& ChunkPos, const bool bCreateIfNotExists)
+{
+    UVoxelChunk* Chunk = Chunks.Find(ChunkPos);
 
-    if (!Find)
+    if (!Chunk && bCreateIfNotExists)
     {
-        return nullptr;
+        check(IsInGameThread());
+        return NewChunk(ChunkPos);
     }
 
-    return *Find;
+    return Chunk;
 }
 
 void UVoxelWorld::OnChunkDestroyed(UVoxelChunk* Chunk)
 {
+    //Drop its queued works now, so it doesn't wait for them to run
+    TArray<FVoxelChunkJob> Removed;
+    Scheduler.RemoveJobs(Chunk, Removed);
+
+    for (const FVoxelChunkJob& Job : Removed)
+    {
+        CancelChunkJob(Job);
+    }
+
     ToDestroy.Add(Chunk);
 }
 
@@ -256,43 +519,66 @@ void UVoxelWorld::FinalizeDestroyChunk(UVoxelChunk* Chunk)
     Chunks.Remove(Chunk->ChunkPos);
     ChunksArray.RemoveSwap(Chunk);
 
-    delete Chunk;
+    for (int FaceNum = 0; FaceNum < 6; FaceNum++)
+    {
+        const EBlockFace Face = static_cast<EBlockFace>(FaceNum);
+
+        UVoxelChunk* Neighbor = Chunk->GetNeighbor(Face);
+        if (Neighbor)
+        {
+            Neighbor->SetNeighbor(FVoxelUtilities::GetOppositeFace(Face), nullptr);
+            Neighbor->ResetNeighborDependency(FVoxelUtilities::GetOppositeFace(Face));
+            Chunk->SetNeighbor(Face, nullptr);
+        }
+    }
+
+    //Workers may still be reading it through the map
+    Chunks.Retire(Chunk);
 }
 
-URuntimeMeshComponent* UVoxelWorld::GetFreeMesh()
+URuntimeMeshComponent* UVoxelWorld::GetFreeMeshComponent()
 {
+    if (FreeMeshComponents.Num())
+    {
+        return FreeMeshComponents.Pop(false);
+    }
+
     URuntimeMeshComponent* Comp = nullptr;
 
-    if (FreeMeshComponents.Num())
+    if (bActorPerMesh)
     {
-        Comp = FreeMeshComponents.Pop(false);
+        FActorSpawnParameters Para;
+        Para.Name = FName(FString::Printf(TEXT("VoxelChunkMesh-%d"), FMath::Rand() % 1024));
+
+        ARuntimeMeshActor* Actor = World->SpawnActor<ARuntimeMeshActor>(ARuntimeMeshActor::StaticClass(), Para);
+
+        Actor->SetMobility(EComponentMobility::Movable);
+
+        Comp = Actor->GetRuntimeMeshComponent();
     }
     else
     {
-        if (bActorPerMesh)
-        {
-            FActorSpawnParameters Para;
-            Para.Name = FName(FString::Printf(TEXT("VoxelChunkMesh-%d"), FMath::Rand() % 1024));
+        Comp = NewObject<URuntimeMeshComponent>(MeshActor);
+        Comp->SetupAttachment(MeshActor->GetRootComponent());
+        Comp->RegisterComponent();
+    }
 
-            ARuntimeMeshActor* Actor = World->SpawnActor<ARuntimeMeshActor>(ARuntimeMeshActor::StaticClass(), Para);
+    MeshComponents.Add(Comp);
 
-            Actor->SetMobility(EComponentMobility::Movable);
+    return Comp;
+}
 
-            Comp = Actor->GetRuntimeMeshComponent();
-        }
-        else
-        {
-            Comp = NewObject<URuntimeMeshComponent>(MeshActor);
-            Comp->SetupAttachment(MeshActor->GetRootComponent());
-            Comp->RegisterComponent();
-        }
-    }
+URuntimeMeshComponent* UVoxelWorld::GetFreeMesh(UVoxelChunk* Chunk)
+{
+    URuntimeMeshComponent* Comp = GetFreeMeshComponent();
 
     UVoxelRMCProvider* Provider = NewObject<UVoxelRMCProvider>(Comp);
 
     Provider->InitVoxel(this);
     Comp->Initialize(Provider);
-    
+
+    Comp->SetRelativeLocation(FVector(Chunk->GetMinPos()) * VoxelSize);
+
     return Comp;
 }
 
@@ -302,12 +588,69 @@ void UVoxelWorld::ReleaseMesh(URuntimeMeshComponent* Comp)
     FreeMeshComponents.Add(Comp);
 }
 
-void UVoxelWorld::SetupMesh(UVoxelChunk* Chunk)
+UVoxelRegionProvider* UVoxelWorld::AddToRegion(UVoxelChunk* Chunk)
 {
-    URuntimeMeshComponent* Comp = GetFreeMesh();
+    const FIntVector RegionPos = GetRegionPos(Chunk->ChunkPos);
 
-    Comp->SetRelativeLocation(FVector(Chunk->GetMinPos()) * VoxelSize);
-    Chunk->InitMesh(Comp);
+    URuntimeMeshComponent*& Comp = RegionComponents.FindOrAdd(RegionPos);
+
+    if (!Comp)
+    {
+        Comp = GetFreeMeshComponent();
+
+        UVoxelRegionProvider* Provider = NewObject<UVoxelRegionProvider>(Comp);
+
+        Provider->InitRegion(this, RegionPos);
+        Comp->Initialize(Provider);
+
+        Comp->SetRelativeLocation(FVector(RegionPos * RegionSize * VOX_CHUNKSIZE) * VoxelSize);
+    }
+
+    UVoxelRegionProvider* Provider = CastChecked<UVoxelRegionProvider>(Comp->GetProvider());
+    Provider->AddChunk(Chunk);
+
+    return Provider;
+}
+
+void UVoxelWorld::RemoveFromRegion(UVoxelChunk* Chunk, UVoxelRegionProvider* RegionProvider)
+{
+    RegionProvider->RemoveChunk(Chunk);
+
+    if (RegionProvider->GetNumChunks() == 0)
+    {
+        ReleaseMesh(RegionComponents.FindAndRemoveChecked(GetRegionPos(Chunk->ChunkPos)));
+    }
+}
+
+bool UVoxelWorld::ShouldBeBatched(UVoxelChunk* Chunk)
+{
+    if (!bBatchChunks)
+    {
+        return false;
+    }
+
+    //Edited often, one chunk remeshes and uploads faster than sections of a whole region
+    if (IsInBatchCooldown(Chunk))
+    {
+        return false;
+    }
+
+    return GetMinDistanceToTrackers(Chunk->ChunkPos) > UnbatchDistance;
+}
+
+bool UVoxelWorld::IsInBatchCooldown(UVoxelChunk* Chunk) const
+{
+    const double LastEditTime = Chunk->GetLastEditTime();
+
+    return LastEditTime > 0.0 && FPlatformTime::Seconds() - LastEditTime < BatchEditCooldown;
+}
+
+void UVoxelWorld::QueueBatchCooldown(UVoxelChunk* Chunk)
+{
+    if (bBatchChunks)
+    {
+        BatchCooldowns.HeapPush({ Chunk->GetLastEditTime() + BatchEditCooldown, Chunk->ChunkPos });
+    }
 }
 
 FVoxelMesher* UVoxelWorld::GetMesher()
@@ -334,67 +677,284 @@ float UVoxelWorld::GetMinDistanceToTrackers(const FIntVector& ChunkPos)
     return Min;
 }
 
+void UVoxelWorld::MoveTrackerInterest(const FIntVector* OldChunkPos, const FIntVector* NewChunkPos)
+{
+    const float CreationDistance = RenderDistance + DestroyExtent;
+
+    //Entering chunks, and chunks staying in creation distance that enter or leave render distance
+    if (NewChunkPos)
+    {
+        for (const FIntVector& Offset : SphereOffsets)
+        {
+            const FIntVector ChunkPos = *NewChunkPos + Offset;
+            const bool bNewRender = FVector(Offset).Size() < RenderDistance;
+
+            bool bOldInterest = false;
+            bool bOldRender = false;
+
+            if (OldChunkPos)
+            {
+                const float OldDistance = FVector(ChunkPos - *OldChunkPos).Size();
+
+                bOldInterest = OldDistance <= CreationDistance;
+                bOldRender = OldDistance < RenderDistance;
+            }
+
+            AddChunkInterest(ChunkPos, bOldInterest ? 0 : 1, int(bNewRender) - int(bOldRender));
+        }
+    }
+
+    //Leaving chunks
+    if (OldChunkPos)
+    {
+        for (const FIntVector& Offset : SphereOffsets)
+        {
+            const FIntVector ChunkPos = *OldChunkPos + Offset;
+
+            if (NewChunkPos && FVector(ChunkPos - *NewChunkPos).Size() <= CreationDistance)
+            {
+                continue;
+            }
+
+            const bool bOldRender = FVector(Offset).Size() < RenderDistance;
+
+            AddChunkInterest(ChunkPos, -1, bOldRender ? -1 : 0);
+        }
+    }
+
+    if (bBatchChunks)
+    {
+        ActivateUnbatchedChanges(OldChunkPos, NewChunkPos);
+    }
+}
+
+void UVoxelWorld::ActivateUnbatchedChanges(const FIntVector* OldChunkPos, const FIntVector* NewChunkPos)
+{
+    const int Radius = FMath::CeilToInt(UnbatchDistance);
+
+    auto IsNear = [this](const FIntVector& ChunkPos, const FIntVector* TrackerChunkPos)
+    {
+        return TrackerChunkPos && FVector(ChunkPos - *TrackerChunkPos).Size() <= UnbatchDistance;
+    };
+
+    //Chunks near only one of the positions, each is visited from that one
+    for (const FIntVector* CenterPos : { OldChunkPos, NewChunkPos })
+    {
+        if (!CenterPos)
+        {
+            continue;
+        }
+
+        for (int X = -Radius; X <= Radius; X++)
+        {
+            for (int Y = -Radius; Y <= Radius; Y++)
+            {
+                for (int Z = -Radius; Z <= Radius; Z++)
+                {
+                    const FIntVector ChunkPos = *CenterPos + FIntVector(X, Y, Z);
+
+                    if (!IsNear(ChunkPos, CenterPos) || IsNear(ChunkPos, OldChunkPos) == IsNear(ChunkPos, NewChunkPos))
+                    {
+                        continue;
+                    }
+
+                    //Switches only if no other tracker keeps it where it is, its tick decides
+                    UVoxelChunk* Chunk = GetChunk(ChunkPos);
+                    if (Chunk)
+                    {
+                        ActivateChunk(Chunk);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void UVoxelWorld::AddChunkInterest(const FIntVector& ChunkPos, const int InterestDelta, const int RenderDelta)
+{
+    if (InterestDelta == 0 && RenderDelta == 0)
+    {
+        return;
+    }
+
+    FVoxelChunkInterest& Interest = ChunkInterests.FindOrAdd(ChunkPos);
+
+    Interest.InterestCount += InterestDelta;
+    Interest.RenderCount += RenderDelta;
+
+    check(Interest.InterestCount >= 0 && Interest.RenderCount >= 0);
+
+    //Went from or to zero
+    const bool bInterestChanged = InterestDelta != 0 && (Interest.InterestCount == 0 || Interest.InterestCount == InterestDelta);
+    const bool bRenderChanged = RenderDelta != 0 && (Interest.RenderCount == 0 || Interest.RenderCount == RenderDelta);
+
+    if (Interest.InterestCount == 0)
+    {
+        ChunkInterests.Remove(ChunkPos);
+    }
+
+    //Chunk should be created, destroyed, or rendered now
+    if (bInterestChanged || bRenderChanged)
+    {
+        UVoxelChunk* Chunk = GetChunk(ChunkPos, InterestDelta > 0);
+        if (Chunk)
+        {
+            ActivateChunk(Chunk);
+        }
+    }
+}
+
 bool UVoxelWorld::ShouldBeRendered(const FIntVector& Chunk)
 {
-    return GetMinDistanceToTrackers(Chunk) < RenderDistance;
+    const FVoxelChunkInterest* Interest = ChunkInterests.Find(Chunk);
+    return Interest && Interest->RenderCount > 0;
 }
 
 bool UVoxelWorld::ShouldBeDestroyed(const FIntVector& Chunk)
 {
-    return GetMinDistanceToTrackers(Chunk) > RenderDistance + DestroyExtent;
+    return !ChunkInterests.Contains(Chunk);
 }
 
-void FQueuedChunkWork::DoThreadedWork()
+void UVoxelWorld::UpdateTrackerViews()
+{
+    TArray<FVoxelTrackerView> Views;
+    Views.Reserve(Trackers.Num());
+
+    const float ChunkWorldSize = VoxelSize * VOX_CHUNKSIZE;
+
+    for (auto& Tracker : Trackers)
+    {
+        FVector EyeLocation;
+        FRotator EyeRotation;
+        float FOV = 90.0f;
+
+        //Camera of the player possessing it, if there's one
+        APawn* Pawn = Cast<APawn>(Tracker);
+        APlayerController* Controller = Pawn ? Cast<APlayerController>(Pawn->GetController()) : nullptr;
+
+        if (Controller && Controller->PlayerCameraManager)
+        {
+            Controller->GetPlayerViewPoint(EyeLocation, EyeRotation);
+            FOV = Controller->PlayerCameraManager->GetFOVAngle();
+        }
+        else
+        {
+            Tracker->GetActorEyesViewPoint(EyeLocation, EyeRotation);
+        }
+
+        FVoxelTrackerView View;
+        View.ChunkPos = FVoxelUtilities::VoxelPosToChunkPos(ToVoxelPos(Tracker->GetActorLocation()));
+        View.Location = EyeLocation / ChunkWorldSize;
+        View.Direction = EyeRotation.Vector();
+        View.CosHalfFOV = FMath::Cos(FMath::DegreesToRadians(FOV * 0.5f));
+
+        Views.Add(View);
+    }
+
+    Scheduler.UpdateTrackerViews(Views);
+}
+
+void UVoxelWorld::DoChunkJob(const FVoxelChunkJob& Job)
 {
-    auto& Work = Chunk->GetChunkWork(WorkType);
+    UVoxelChunk* Chunk = Job.Chunk;
+    auto& Work = Chunk->GetChunkWork(Job.WorkType);
 
-    //Is this work invalid?
-    if (Work.CurrentWorkId.GetValue() != WorkId)
+    //Is this work invalid or chunk gone?
+    if (Work.CurrentWorkId.GetValue() != Job.WorkId || Chunk->IsDestroying())
     {
-        delete this;
+        CancelChunkJob(Job);
         return;
     }
 
-    switch (WorkType)
+    bool bFinished = false;
+
+    switch (Job.WorkType)
     {
     case EChunkWorkType::WorldGen:
     {
-        Chunk->GenerateChunk();
+        bFinished = Chunk->GenerateChunk();
         break;
     }
     case EChunkWorkType::Collision:
     {
-        Chunk->BuildCollision();
+        bFinished = Chunk->BuildCollision();
         break;
     }
     case EChunkWorkType::Mesh:
     {
-        Chunk->PolygonizeChunk();
+        bFinished = Chunk->PolygonizeChunk();
+        break;
+    }
+    case EChunkWorkType::MeshAndCollision:
+    {
+        bFinished = Chunk->PolygonizeAndBuildCollision();
         break;
     }
     }
 
-    if (Work.CurrentWorkId.GetValue() != WorkId)
+    if (!bFinished)
     {
-        ensureAlways(false);
+        CancelChunkJob(Job);
+        return;
+    }
 
-        delete this;
+    if (!ensureAlways(Work.CurrentWorkId.GetValue() == Job.WorkId))
+    {
+        CancelChunkJob(Job);
         return;
     }
 
     Work.bIsDone = true;
     Work.bIsWorkOnline = false;
 
+    ActivateChunk(Chunk);
+
+    Chunk->RemainingWorks.Decrement();
+    JobsRemaining.Decrement();
+}
+
+void UVoxelWorld::CancelChunkJob(const FVoxelChunkJob& Job)
+{
+    UVoxelChunk* Chunk = Job.Chunk;
+    auto& Work = Chunk->GetChunkWork(Job.WorkType);
+
+    //Superseded work doesn't own Work state anymore
+    if (Work.CurrentWorkId.GetValue() == Job.WorkId)
+    {
+        Work.bIsCancelled = true;
+        Work.bIsWorkOnline = false;
+    }
+
+    CancelledJobs.Increment();
+    JobsRemaining.Decrement();
+
+    ActivateChunk(Chunk);
+
+    //Last, chunk may be finally destroyed after this
     Chunk->RemainingWorks.Decrement();
-    Chunk->VoxelWorld->JobsRemaining.Decrement();
+}
+
+void FQueuedChunkWork::DoThreadedWork()
+{
+    FVoxelChunkJob Job;
+
+    //One ticket per job, so there's always one unless the scheduler was reset
+    if (VoxelWorld->Scheduler.PopJob(Job))
+    {
+        VoxelWorld->DoChunkJob(Job);
+    }
 
     delete this;
 }
 
 void FQueuedChunkWork::Abandon()
 {
-    Chunk->RemainingWorks.Decrement();
-    Chunk->VoxelWorld->JobsRemaining.Decrement();
+    FVoxelChunkJob Job;
+
+    if (VoxelWorld->Scheduler.PopJob(Job))
+    {
+        VoxelWorld->CancelChunkJob(Job);
+    }
 
     delete this;
 }
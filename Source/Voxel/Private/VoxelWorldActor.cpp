@@ -21,7 +21,7 @@ void AVoxelWorldActor::Tick(float DeltaTime)
 
 	if (VoxelWorld)
 	{
-		VoxelWorld->Tick();
+		VoxelWorld->Tick(DeltaTime);
 	}
 }
 
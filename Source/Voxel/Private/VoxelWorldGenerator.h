@@ -14,12 +14,12 @@ class UVoxelWorldGenerator : public UObject
 public:
 	UVoxelWorldGenerator() { };
 
-	virtual void GenerateChunk(UVoxelChunk* Chunk)
+	//Called from worker threads, fill BlockStorage which is not yet visible to others
+	virtual void GenerateChunk(UVoxelChunk* Chunk, FVoxelBlockStorage& BlockStorage)
 	{
 		unimplemented();
 
 		const FIntVector ChunkPos = Chunk->GetMinPos();
-		const auto BlockStorage = Chunk->GetBlockStorage();
 
 		for (int X = 0; X < VOX_CHUNKSIZE; X++)
 		{
@@ -40,10 +40,23 @@ class UVoxelFlatWorldGenerator : public UVoxelWorldGenerator
 	GENERATED_BODY()
 
 public:
-	void GenerateChunk(UVoxelChunk* Chunk) override
+	void GenerateChunk(UVoxelChunk* Chunk, FVoxelBlockStorage& BlockStorage) override
 	{
 		const FIntVector ChunkPos = Chunk->GetMinPos();
-		const auto BlockStorage = Chunk->GetBlockStorage();
+
+		//Look up once, not per voxel
+		UVoxelBlockDef* SolidBlock = GetVoxelBlock(TEXT("SolidDefault"));
+
+		//Whole chunk is above or below the ground
+		if (ChunkPos.Z >= 2)
+		{
+			return;
+		}
+		if (ChunkPos.Z + VOX_CHUNKSIZE <= 2)
+		{
+			BlockStorage.Fill(SolidBlock);
+			return;
+		}
 
 		for (int X = 0; X < VOX_CHUNKSIZE; X++)
 		{
@@ -55,7 +68,7 @@ public:
 
 					if (GlobalPos.Z < 2)
 					{
-						BlockStorage->SetBlock(X, Y, Z, GetVoxelBlock(TEXT("SolidDefault")));
+						BlockStorage.SetBlock(X, Y, Z, SolidBlock);
 					}
 				}
 			}
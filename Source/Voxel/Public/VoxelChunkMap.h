@@ -0,0 +1,114 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UVoxelChunk;
+
+//Chunk position to chunk map with lock-free reads, written only by game thread.
+//Open addressing with linear probing, slots are written once then only turned into tombstones,
+//so readers never see a slot change under them. Tables are rebuilt to grow or to drop tombstones.
+//Removed chunks and old tables are retired, and freed when no reader can still see them (two-parity epochs).
+class FVoxelChunkMap
+{
+private:
+	struct FTable
+	{
+		int32 Capacity = 0;
+
+		//Used slots, including tombstones
+		int32 NumUsed = 0;
+
+		//Written before its value is published
+		TUniquePtr<uint64[]> Keys;
+		TUniquePtr<TAtomic<UVoxelChunk*>[]> Values;
+
+		FTable(const int32 InCapacity);
+	};
+
+	template<typename T>
+	struct TRetired
+	{
+		T* Object;
+		uint64 Epoch;
+	};
+
+	TAtomic<FTable*> CurrentTable;
+
+	//Live chunks
+	int32 Num = 0;
+
+	TAtomic<uint64> GlobalEpoch;
+
+	//Readers inside a read scope, by parity of the epoch they entered in
+	mutable TAtomic<int32> ReaderCounts[2];
+
+	TArray<TRetired<FTable>> RetiredTables;
+	TArray<TRetired<UVoxelChunk>> RetiredChunks;
+
+public:
+	//Keeps chunks found inside it from being freed, required on worker threads
+	class FReadScope
+	{
+		const FVoxelChunkMap& Map;
+		uint64 Epoch;
+
+	public:
+		FReadScope(const FVoxelChunkMap& InMap);
+		~FReadScope();
+	};
+
+	FVoxelChunkMap();
+	~FVoxelChunkMap();
+
+	//Lock-free, inside a FReadScope or on game thread
+	UVoxelChunk* Find(const FIntVector& ChunkPos) const;
+
+	//Game thread only
+
+	void Add(const FIntVector& ChunkPos, UVoxelChunk* Chunk);
+	void Remove(const FIntVector& ChunkPos);
+
+	//Chunk will be passed to Reclaim once no reader can see it anymore
+	void Retire(UVoxelChunk* Chunk);
+
+	//Frees retired tables, and calls DeleteChunk on retired chunks safe to free
+	//bForce - No reader left at all, free everything (World destroy)
+	void Reclaim(TFunctionRef<void(UVoxelChunk*)> DeleteChunk, const bool bForce = false);
+
+	void Empty();
+
+	int32 GetNum() const
+	{
+		return Num;
+	}
+
+	int32 GetNumRetired() const
+	{
+		return RetiredChunks.Num();
+	}
+
+private:
+	static inline UVoxelChunk* GetTombstone()
+	{
+		return reinterpret_cast<UVoxelChunk*>(UPTRINT(1));
+	}
+
+	static inline uint64 PackKey(const FIntVector& ChunkPos)
+	{
+		//21 bits per axis, more than enough chunks in every direction
+		return (uint64(ChunkPos.X) & 0x1FFFFF)
+			| ((uint64(ChunkPos.Y) & 0x1FFFFF) << 21)
+			| ((uint64(ChunkPos.Z) & 0x1FFFFF) << 42);
+	}
+
+	static inline uint32 HashKey(const uint64 Key)
+	{
+		//Fibonacci hashing, upper bits are well mixed
+		return uint32((Key * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+
+	//Builds a new table of live entries and publishes it
+	void Rebuild(const int32 NewCapacity);
+
+	static void Insert(FTable& Table, const uint64 Key, UVoxelChunk* Chunk);
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UVoxelChunk;
+
+enum class EChunkWorkType
+{
+	//MeshAndCollision does both from one pass over the voxels, Collision alone is for chunks without render mesh
+	WorldGen, Collision, Mesh, MeshAndCollision
+};
+
+//Where a tracker is and where it looks, snapshot taken on game thread
+struct FVoxelTrackerView
+{
+	FIntVector ChunkPos = FIntVector(0);
+
+	//In chunk units
+	FVector Location = FVector::ZeroVector;
+
+	FVector Direction = FVector::ForwardVector;
+
+	//Cosine of half of horizontal FOV
+	float CosHalfFOV = 0.0f;
+};
+
+struct FVoxelChunkJob
+{
+	UVoxelChunk* Chunk = nullptr;
+	EChunkWorkType WorkType = EChunkWorkType::WorldGen;
+	uint64 WorkId = 0;
+
+	//Caused by block edit, goes before everything else
+	bool bIsEdit = false;
+
+	//Lower runs first
+	float Priority = 0.0f;
+
+	bool operator<(const FVoxelChunkJob& Other) const
+	{
+		return Priority < Other.Priority;
+	}
+};
+
+//Priority queue of chunk works, shared by all worker threads.
+//Thread pool only gets tickets, every ticket runs the best job queued at the time it starts,
+//so the chunk under a tracker never waits behind chunks queued earlier at the edge of render distance.
+//Priority is distance to nearest tracker, scaled up if the chunk is outside of every tracker's view, edits first.
+class FVoxelJobScheduler
+{
+private:
+	//Binary heap on Priority
+	TArray<FVoxelChunkJob> Jobs;
+
+	TArray<FVoxelTrackerView> TrackerViews;
+
+	mutable FCriticalSection Lock;
+
+public:
+	//Distance multiplier for chunks no tracker is looking at
+	float OutOfViewPenalty = 2.0f;
+
+	//Chunks closer than this are treated as in view, whatever the direction is
+	float NearDistance = 1.5f;
+
+	void AddJob(UVoxelChunk* Chunk, EChunkWorkType WorkType, uint64 WorkId, bool bIsEdit);
+
+	//Pops the best job, false if empty
+	bool PopJob(FVoxelChunkJob& OutJob);
+
+	//Removes every queued job of Chunk, their tickets will find nothing to run
+	void RemoveJobs(UVoxelChunk* Chunk, TArray<FVoxelChunkJob>& OutRemoved);
+
+	//Priorities are re-evaluated if any tracker moved to other chunk or turned
+	void UpdateTrackerViews(const TArray<FVoxelTrackerView>& NewViews);
+
+	void Reset();
+
+	//Same order as jobs, for game thread work of chunks
+	float GetChunkPriority(const FIntVector& ChunkPos) const;
+
+	int Num() const;
+
+private:
+	float GetPriority(const FVoxelChunkJob& Job) const;
+
+	float GetPriorityUnlocked(const FIntVector& ChunkPos) const;
+
+	bool HasViewChanged(const TArray<FVoxelTrackerView>& NewViews) const;
+};
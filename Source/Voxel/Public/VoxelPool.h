@@ -0,0 +1,324 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Fixed size object pool, allocates objects in slabs of SlabSize and recycles freed slots.
+//Slab memory is only released when the pool is destroyed.
+template<typename T, int SlabSize = 64>
+class TVoxelSlabPool
+{
+private:
+	TArray<void*> Slabs;
+	TArray<T*> FreeSlots;
+
+	int NumUsed = 0;
+	int HighWaterMark = 0;
+
+	//Counters are read under it too
+	mutable FCriticalSection Lock;
+
+public:
+	TVoxelSlabPool() = default;
+	TVoxelSlabPool(const TVoxelSlabPool&) = delete;
+	TVoxelSlabPool& operator=(const TVoxelSlabPool&) = delete;
+
+	~TVoxelSlabPool()
+	{
+		ensureMsgf(NumUsed == 0, TEXT("TVoxelSlabPool destroyed with %d objects alive"), NumUsed);
+
+		for (void* Slab : Slabs)
+		{
+			FMemory::Free(Slab);
+		}
+	}
+
+	//Makes sure at least Num objects can be allocated without allocating new slabs
+	void Reserve(const int Num)
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		while (Slabs.Num() * SlabSize < Num)
+		{
+			AddSlab();
+		}
+	}
+
+	template<typename... ArgsType>
+	T* New(ArgsType&&... Args)
+	{
+		T* Slot = nullptr;
+		{
+			FScopeLock ScopeLock(&Lock);
+
+			if (FreeSlots.Num() == 0)
+			{
+				AddSlab();
+			}
+
+			Slot = FreeSlots.Pop(false);
+
+			NumUsed++;
+			HighWaterMark = FMath::Max(HighWaterMark, NumUsed);
+		}
+
+		return new (Slot) T(Forward<ArgsType>(Args)...);
+	}
+
+	void Delete(T* Object)
+	{
+		if (!Object)
+		{
+			return;
+		}
+
+		Object->~T();
+
+		FScopeLock ScopeLock(&Lock);
+
+		FreeSlots.Push(Object);
+		NumUsed--;
+	}
+
+	int GetNumUsed() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return NumUsed;
+	}
+
+	int GetCapacity() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return Slabs.Num() * SlabSize;
+	}
+
+	//Max number of objects alive at once
+	int GetHighWaterMark() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return HighWaterMark;
+	}
+
+private:
+	void AddSlab()
+	{
+		uint8* Slab = static_cast<uint8*>(FMemory::Malloc(sizeof(T) * SlabSize, alignof(T)));
+		Slabs.Add(Slab);
+
+		//Reverse order, so slots are handed out in address order
+		for (int Index = SlabSize - 1; Index >= 0; Index--)
+		{
+			FreeSlots.Push(reinterpret_cast<T*>(Slab + Index * sizeof(T)));
+		}
+	}
+};
+
+//Pool of shared objects that keep their allocations, for buffers filled again and again.
+//Released objects are kept only if nothing else references them. Contents are left as released, reset them after Acquire.
+template<typename T>
+class TVoxelRecyclePool
+{
+public:
+	typedef TSharedPtr<T, ESPMode::ThreadSafe> FObjectPtr;
+
+private:
+	TArray<FObjectPtr> FreeObjects;
+
+	//Free objects kept at most, rest are freed
+	int MaxFree;
+
+	int NumCreated = 0;
+	int NumReused = 0;
+
+	//Counters are read under it too
+	mutable FCriticalSection Lock;
+
+public:
+	TVoxelRecyclePool(const int InMaxFree = 64)
+		: MaxFree(InMaxFree)
+	{
+	}
+
+	TVoxelRecyclePool(const TVoxelRecyclePool&) = delete;
+	TVoxelRecyclePool& operator=(const TVoxelRecyclePool&) = delete;
+
+	FObjectPtr Acquire()
+	{
+		{
+			FScopeLock ScopeLock(&Lock);
+
+			if (FreeObjects.Num())
+			{
+				NumReused++;
+				return FreeObjects.Pop(false);
+			}
+
+			NumCreated++;
+		}
+
+		return MakeShared<T, ESPMode::ThreadSafe>();
+	}
+
+	void Release(FObjectPtr&& Object)
+	{
+		if (!Object.IsValid() || !Object.IsUnique())
+		{
+			Object = nullptr;
+			return;
+		}
+
+		FScopeLock ScopeLock(&Lock);
+
+		if (FreeObjects.Num() < MaxFree)
+		{
+			FreeObjects.Push(MoveTemp(Object));
+		}
+
+		Object = nullptr;
+	}
+
+	void Empty()
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		FreeObjects.Empty();
+	}
+
+	int GetNumFree() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return FreeObjects.Num();
+	}
+
+	int GetNumCreated() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return NumCreated;
+	}
+
+	int GetNumReused() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return NumReused;
+	}
+};
+
+//Free lists of arrays for a few fixed sizes, free arrays keep their allocation.
+//For big buffers created and freed with every chunk, so they don't go back to the heap each time.
+template<typename T, int NumSizes>
+class TVoxelBufferPool
+{
+private:
+	TArray<TArray<T>> FreeBuffers[NumSizes];
+
+	//Free buffers kept at most per size, rest are freed
+	int MaxFreePerSize;
+
+	int NumCreated = 0;
+	int NumReused = 0;
+
+	//Counters are read under it too
+	mutable FCriticalSection Lock;
+
+public:
+	TVoxelBufferPool(const int InMaxFreePerSize = 64)
+		: MaxFreePerSize(InMaxFreePerSize)
+	{
+	}
+
+	TVoxelBufferPool(const TVoxelBufferPool&) = delete;
+	TVoxelBufferPool& operator=(const TVoxelBufferPool&) = delete;
+
+	//OutBuffer gets Num uninitialized elements, from a free buffer of SizeIndex if there is one
+	void Acquire(const int SizeIndex, const int Num, TArray<T>& OutBuffer)
+	{
+		check(SizeIndex >= 0 && SizeIndex < NumSizes);
+		{
+			FScopeLock ScopeLock(&Lock);
+
+			if (FreeBuffers[SizeIndex].Num())
+			{
+				NumReused++;
+				OutBuffer = FreeBuffers[SizeIndex].Pop(false);
+			}
+			else
+			{
+				NumCreated++;
+			}
+		}
+
+		OutBuffer.SetNumUninitialized(Num, false);
+	}
+
+	//Buffer is left empty
+	void Release(const int SizeIndex, TArray<T>& Buffer)
+	{
+		check(SizeIndex >= 0 && SizeIndex < NumSizes);
+
+		if (Buffer.Max() != 0)
+		{
+			FScopeLock ScopeLock(&Lock);
+
+			if (FreeBuffers[SizeIndex].Num() < MaxFreePerSize)
+			{
+				FreeBuffers[SizeIndex].Push(MoveTemp(Buffer));
+			}
+		}
+
+		Buffer.Empty();
+	}
+
+	//Frees every free buffer, buffers in use are not affected
+	void Empty()
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		for (TArray<TArray<T>>& Buffers : FreeBuffers)
+		{
+			Buffers.Empty();
+		}
+	}
+
+	int GetNumCreated() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return NumCreated;
+	}
+
+	int GetNumReused() const
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		return NumReused;
+	}
+};
+
+//Free lists of the index and color layers of FVoxelBlockStorage, owned by the world creating the storages
+struct FVoxelStorageLayerPools
+{
+	//One per index width, 1 to 16 bits
+	TVoxelBufferPool<uint32, 5> IndexLayers;
+	TVoxelBufferPool<FColor, 1> ColorLayers;
+
+	void Empty()
+	{
+		IndexLayers.Empty();
+		ColorLayers.Empty();
+	}
+
+	int GetNumCreated() const
+	{
+		return IndexLayers.GetNumCreated() + ColorLayers.GetNumCreated();
+	}
+
+	int GetNumReused() const
+	{
+		return IndexLayers.GetNumReused() + ColorLayers.GetNumReused();
+	}
+};
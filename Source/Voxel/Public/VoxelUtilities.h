@@ -12,6 +12,12 @@ inline UVoxelBlockDef* GetVoxelBlock(T Name)
 	return FBlockRegistry::GetInstance_Ptr()->GetBlock(Name);
 }
 
+//Use this instead of GetVoxelBlock when only the block's properties are needed
+inline const FVoxelBlockProperties& GetVoxelBlockProperties(const uint32 Id)
+{
+	return FBlockRegistry::GetBlockProperties(Id);
+}
+
 enum class EBlockFace : uint8
 {
 	FRONT, BACK, LEFT, RIGHT, TOP, BOTTOM
@@ -26,6 +32,21 @@ struct FVoxelBlock
 	{
 		return GetVoxelBlock(BlockId);
 	}
+
+	const FVoxelBlockProperties& GetProperties() const
+	{
+		return GetVoxelBlockProperties(BlockId);
+	}
+
+	bool operator==(const FVoxelBlock& Other) const
+	{
+		return BlockId == Other.BlockId && Color == Other.Color;
+	}
+
+	bool operator!=(const FVoxelBlock& Other) const
+	{
+		return !(*this == Other);
+	}
 };
 
 
@@ -35,52 +56,140 @@ struct FVoxelMeshSection
 
 	UMaterialInterface* Material = nullptr;
 	UVoxelBlockDef* BlockDef = nullptr;
+
+	//16-bit indices unless there are too many vertices, set by ReserveQuads
+	bool bUses32BitIndices = true;
+
+	//Room for NumQuads more quads, 4 vertices and 6 indices each
+	//Picks index size, call before adding vertices
+	void ReserveQuads(const int NumQuads)
+	{
+		check(MeshData.Positions.Num() == 0);
+
+		const int NumVertices = NumQuads * 4;
+
+		const bool bNeeds32BitIndices = NumVertices > MAX_uint16 + 1;
+		if (bNeeds32BitIndices != bUses32BitIndices)
+		{
+			MeshData.Triangles = FRuntimeMeshTriangleStream(bNeeds32BitIndices);
+			bUses32BitIndices = bNeeds32BitIndices;
+		}
+
+		MeshData.Positions.Reserve(NumVertices);
+		MeshData.Tangents.Reserve(NumVertices);
+		MeshData.Colors.Reserve(NumVertices);
+		MeshData.TexCoords.Reserve(NumVertices);
+		MeshData.Triangles.Reserve(NumQuads * 6);
+	}
+
+	//Empty, keeping allocations
+	void Reset()
+	{
+		MeshData.Positions.SetNum(0, false);
+		MeshData.Tangents.SetNum(0, false);
+		MeshData.Colors.SetNum(0, false);
+		MeshData.TexCoords.SetNum(0, false);
+		MeshData.Triangles.SetNum(0, false);
+
+		Material = nullptr;
+		BlockDef = nullptr;
+	}
 };
 
 struct FVoxelMeshData
 {
 	TArray<FVoxelMeshSection> Sections;
 
-	TMap<UVoxelBlockDef*, int> IndexCache;
+	//Section index of each section key of block registry, INDEX_NONE if no section yet
+	TArray<int> SectionIndices;
 
-	FVoxelMeshSection& GetSectionFor(UVoxelBlockDef* BlockDef)
+	//Sections emptied by Reset, handed out again before making new ones
+	TArray<FVoxelMeshSection> SpareSections;
+
+	//Version of the chunk storage this mesh was made from
+	uint64 StorageVersion = 0;
+
+	//Corners of emitted quads, and vertices they ended up using
+	int32 NumQuadCorners = 0;
+	int32 NumVertices = 0;
+
+	//Downsampled meshes of LOD 1 and further, kept with their allocations over Reset
+	TArray<FVoxelMeshData> LODs;
+
+	//Parts that were meshed. Edit meshes have no LODs and the mesh built after them has only LODs,
+	//providers keep their current mesh of a part that's missing
+	bool bHasLOD0 = true;
+	bool bHasLODs = true;
+
+	//LODIndex 0 is this
+	FVoxelMeshData& GetLOD(const int LODIndex)
 	{
-		check(BlockDef->ShouldBePolygonized());
+		return LODIndex == 0 ? *this : LODs[LODIndex - 1];
+	}
 
-		int* FindCache = IndexCache.Find(BlockDef);
+	int GetNumLODs() const
+	{
+		return LODs.Num() + 1;
+	}
 
-		if (FindCache)
+	//Empty, keeping allocations of sections for next mesh
+	void Reset()
+	{
+		for (FVoxelMeshSection& Section : Sections)
 		{
-			return Sections[*FindCache];
+			Section.Reset();
+			SpareSections.Add(MoveTemp(Section));
 		}
 
-		int ResultIndex = -1;
+		Sections.Reset();
+		SectionIndices.Reset();
+
+		StorageVersion = 0;
 
-		for (int i = 0; i < Sections.Num(); i++)
+		NumQuadCorners = 0;
+		NumVertices = 0;
+
+		bHasLOD0 = true;
+		bHasLODs = true;
+
+		for (FVoxelMeshData& LOD : LODs)
 		{
-			if ((BlockDef->bSeparateMeshSections && Sections[i].BlockDef == BlockDef)
-				|| (!BlockDef->bSeparateMeshSections && Sections[i].Material == BlockDef->Material))
-			{
-				ResultIndex = i;
-				break;
-			}
+			LOD.Reset();
 		}
+	}
 
-		if (ResultIndex == -1)
-		{
-			ResultIndex = Sections.Num();
+	FVoxelMeshSection& GetSectionFor(UVoxelBlockDef* BlockDef)
+	{
+		return Sections[GetSectionIndexFor(BlockDef->TypeId)];
+	}
+
+	int GetSectionIndexFor(const uint32 BlockId)
+	{
+		const int SectionKey = GetVoxelBlockProperties(BlockId).SectionKey;
+		check(SectionKey != INDEX_NONE);
 
-			FVoxelMeshSection NewSection;
+		if (SectionIndices.Num() == 0)
+		{
+			SectionIndices.Init(INDEX_NONE, FBlockRegistry::GetInstance_Ptr()->GetNumSectionKeys());
+		}
 
-			NewSection.Material = BlockDef->Material;
-			NewSection.BlockDef = BlockDef;
+		int& SectionIndex = SectionIndices[SectionKey];
 
-			Sections.Emplace(NewSection);
+		if (SectionIndex != INDEX_NONE)
+		{
+			return SectionIndex;
 		}
 
-		IndexCache.Add(BlockDef, ResultIndex);
+		UVoxelBlockDef* BlockDef = GetVoxelBlock(BlockId);
+
+		FVoxelMeshSection NewSection = SpareSections.Num() ? SpareSections.Pop(false) : FVoxelMeshSection();
+
+		NewSection.Material = BlockDef->Material;
+		NewSection.BlockDef = BlockDef;
+
+		SectionIndex = Sections.Emplace(MoveTemp(NewSection));
 
-		return Sections[ResultIndex];
+		return SectionIndex;
 	}
 };
 
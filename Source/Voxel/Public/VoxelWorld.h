@@ -4,23 +4,66 @@
 #include "VoxelUtilities.h"
 #include "RuntimeMeshComponent.h"
 #include "Misc/QueuedThreadPool.h"
+#include "Containers/Queue.h"
+#include "VoxelPool.h"
+#include "VoxelJobScheduler.h"
+#include "VoxelChunkMap.h"
 
 #include "VoxelWorld.generated.h"
 
 class UVoxelWorldGenerator;
 class UVoxelChunk;
+class UVoxelRegionProvider;
 class FVoxelMesher;
-enum class EChunkWorkType;
+class FVoxelBlockStorage;
 
+//Last chunk a tracker was in, its interest is applied around it
+struct FVoxelTrackerState
+{
+	FIntVector ChunkPos = FIntVector(0);
+	bool bHasInterest = false;
+};
+
+//Number of trackers interested in a chunk, and of those that render it
+struct FVoxelChunkInterest
+{
+	int InterestCount = 0;
+	int RenderCount = 0;
+};
+
+//Chunk to activate when its BatchEditCooldown ends
+struct FVoxelBatchCooldown
+{
+	double ExpireTime = 0.0;
+	FIntVector ChunkPos = FIntVector(0);
+
+	bool operator<(const FVoxelBatchCooldown& Other) const
+	{
+		return ExpireTime < Other.ExpireTime;
+	}
+};
+
+//Measures a game thread chunk update against the update budget of the world
+struct FVoxelUpdateScope
+{
+	UVoxelWorld* VoxelWorld;
+	uint64 StartCycles;
+
+	FVoxelUpdateScope(UVoxelWorld* InVoxelWorld)
+		: VoxelWorld(InVoxelWorld), StartCycles(FPlatformTime::Cycles64())
+	{ };
+
+	~FVoxelUpdateScope();
+};
+
+//Ticket for one job of FVoxelJobScheduler, runs the best job queued when a worker picks it up
 class FQueuedChunkWork : public IQueuedWork
 {
-	UVoxelChunk* Chunk;
-	EChunkWorkType WorkType;
-	uint64 WorkId;
+	UVoxelWorld* VoxelWorld;
 
 public:
-	FQueuedChunkWork(UVoxelChunk* InChunk, EChunkWorkType InWorkType, uint64 InWorkId)
-		: Chunk(InChunk), WorkType(InWorkType), WorkId(InWorkId)
+	FQueuedChunkWork(UVoxelWorld* InVoxelWorld)
+		: VoxelWorld(InVoxelWorld)
 	{ };
 
 	void DoThreadedWork() override;
@@ -42,24 +85,87 @@ public:
 	UPROPERTY()
 	float RenderDistance = 8.0f;
 
+	//At least 1, see CreateWorld
 	UPROPERTY()
 	float DestroyExtent = 2.0f;
 
+	//Distance in chunks where each LOD after full detail starts, 2x, 4x, 8x downsampled. At most VOX_MAXLODS - 1.
+	UPROPERTY()
+	TArray<float> LODDistances = { 3.0f, 6.0f, 12.0f };
+
+	//Far chunks share one mesh component per region of RegionSize^3 chunks, one section per material
+	UPROPERTY()
+	bool bBatchChunks = true;
+
+	//In chunks. A chunk update re-copies every member of the sections it touches,
+	//and a collision change rebuilds and re-cooks the collision of every member of the region.
+	//Bigger regions mean fewer components but slower updates
 	UPROPERTY()
-	int MaxUpdatesPerTick = 40;
+	int RegionSize = 2;
+
+	//Chunks closer than this to a tracker keep their own component, in chunks
+	UPROPERTY()
+	float UnbatchDistance = 2.0f;
+
+	//Edited chunks keep their own component for this long after their last edit, in seconds
+	UPROPERTY()
+	float BatchEditCooldown = 10.0f;
+
+	//Game thread time for chunk updates per frame, when frames take TargetFrameTimeMs
+	UPROPERTY()
+	float UpdateBudgetMs = 4.0f;
+
+	//Budget grows when frames are faster than this, and shrinks when slower
+	UPROPERTY()
+	float TargetFrameTimeMs = 16.6f;
+
+	UPROPERTY()
+	float MinUpdateBudgetMs = 0.5f;
+
+	UPROPERTY()
+	float MaxUpdateBudgetMs = 8.0f;
+
+	//Number of chunks to pre-allocate in pool at CreateWorld
+	UPROPERTY()
+	int ChunkPoolPreReserve = 0;
 
 	FThreadSafeCounter JobsRemaining;
 
+	FThreadSafeCounter64 NextWorkId;
+
+	//Jobs dropped because their chunk was destroyed or the work was superseded
+	FThreadSafeCounter CancelledJobs;
+
+	FVoxelJobScheduler Scheduler;
+
+	TVoxelSlabPool<FVoxelBlockStorage> BlockStoragePool;
+
+	//Layers of storages in BlockStoragePool, freed with the world
+	FVoxelStorageLayerPools StorageLayerPools;
+
+	//Mesh buffers of providers, recycled with their capacity when replaced by newer ones
+	TVoxelRecyclePool<FVoxelMeshData> MeshDataPool;
+	TVoxelRecyclePool<FRuntimeMeshCollisionData> CollisionDataPool;
+
 private:
 	TSharedPtr<FBlockRegistryInstance> BlockRegistryPtr;
 
 protected:
-	TMap<FIntVector, UVoxelChunk*> Chunks;
+	TVoxelSlabPool<UVoxelChunk> ChunkPool;
+
+	//Lock-free reads from any thread, written on game thread
+	FVoxelChunkMap Chunks;
+
+	//Game thread only
 	TArray<UVoxelChunk*> ChunksArray;
 
 	TArray<UVoxelChunk*> ToDestroy;
 
-	FRWLock ChunksLock;
+	//Chunks to tick next frame, filled from any thread
+	TQueue<UVoxelChunk*, EQueueMode::Mpsc> ActivationQueue;
+
+	//Chunks ticked this frame
+	TArray<UVoxelChunk*> ActiveChunks;
 
 	UPROPERTY()
 	AActor* MeshActor;
@@ -70,18 +176,46 @@ protected:
 	UPROPERTY()
 	TArray<URuntimeMeshComponent*> FreeMeshComponents;
 
+	//Components of regions with batched chunks, by region position
+	UPROPERTY()
+	TMap<FIntVector, URuntimeMeshComponent*> RegionComponents;
+
 	UPROPERTY()
 	UWorld* World;
 
 	UPROPERTY()
 	TArray<AActor*> Trackers;
 
+	//Same indices as Trackers
+	TArray<FVoxelTrackerState> TrackerStates;
+
+	//Chunks in creation distance of any tracker, no entry if none
+	TMap<FIntVector, FVoxelChunkInterest> ChunkInterests;
+
+	//Chunk offsets in creation distance, nearest first
+	TArray<FIntVector> SphereOffsets;
+
+	//Binary heap on ExpireTime, at most one entry per edited chunk
+	TArray<FVoxelBatchCooldown> BatchCooldowns;
+
 	FVoxelMesher* Mesher = nullptr;
 
 	FQueuedThreadPool* ThreadPool;
 
 	int UpdatesThisTick = 0;
 
+	//Game thread chunk updates, in FPlatformTime cycles
+	uint64 UpdateCyclesThisTick = 0;
+	uint64 UpdateBudgetCycles = 0;
+
+	float SmoothedFrameTimeMs = 16.6f;
+
+	//Uploaded meshes, for vertex reuse readout
+	int64 UploadedQuadCorners = 0;
+	int64 UploadedVertices = 0;
+
+	float LastVertexReuseRatio = 0.0f;
+
 	bool bIsWorldCreated = false;
 
 	bool bActorPerMesh = false;
@@ -97,33 +231,122 @@ public:
 	void CreateWorld(UWorld* InWorld);
 	void DestroyWorld();
 
-	void Tick();
+	void Tick(float DeltaTime);
 
 	void RegisterTracker(AActor* Actor);
 
-	void QueueChunkWork(UVoxelChunk* Chunk, EChunkWorkType Type);
+	//Thread safe, does nothing if the same work is already queued or running
+	//bIsEdit - Work caused by block edit, runs before other works
+	void QueueChunkWork(UVoxelChunk* Chunk, EChunkWorkType Type, bool bIsEdit = false);
+
+	//Runs a popped job on worker thread
+	void DoChunkJob(const FVoxelChunkJob& Job);
+
+	//Drops a job that was queued but won't finish
+	void CancelChunkJob(const FVoxelChunkJob& Job);
 
 	UVoxelChunk* NewChunk(const FIntVector& ChunkPos);
+
+	//Chunk will be ticked next frame, thread safe. Only chunks with something to do need ticking.
+	void ActivateChunk(UVoxelChunk* Chunk);
+
+	//Empty buffers to mesh into, from the pools. Any thread
+	TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe> AllocateMeshData();
+	TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe> AllocateCollisionData();
+
+	//Buffers replaced or not submitted, back to the pools once nothing else holds them. Any thread
+	void DiscardMeshData(TSharedPtr<FVoxelMeshData, ESPMode::ThreadSafe>&& MeshData);
+	void DiscardCollisionData(TSharedPtr<FRuntimeMeshCollisionData, ESPMode::ThreadSafe>&& CollisionData);
+
+	//New pooled storage, copy of CopyFrom if given
+	TSharedPtr<FVoxelBlockStorage, ESPMode::ThreadSafe> NewBlockStorage(const FVoxelBlockStorage* CopyFrom = nullptr);
+	//Lock-free. On worker threads, hold a FVoxelChunkMap::FReadScope of GetChunkMap() while using the result.
+	//bCreateIfNotExists - Game thread only
 	UVoxelChunk* GetChunk(const FIntVector& ChunkPos, const bool bCreateIfNotExists = false);
 
+	const FVoxelChunkMap& GetChunkMap() const
+	{
+		return Chunks;
+	}
+
 	void OnChunkDestroyed(UVoxelChunk* Chunk);
 	void FinalizeDestroyChunk(UVoxelChunk* Chunk);
 
-	URuntimeMeshComponent* GetFreeMesh();
+	//Component with a chunk provider, placed at the chunk
+	URuntimeMeshComponent* GetFreeMesh(UVoxelChunk* Chunk);
 	void ReleaseMesh(URuntimeMeshComponent* Comp);
 
-	void SetupMesh(UVoxelChunk* Chunk);
+	//Pooled or new component, without provider
+	URuntimeMeshComponent* GetFreeMeshComponent();
+
+	//Region provider of the chunk, its component is created with the first member
+	UVoxelRegionProvider* AddToRegion(UVoxelChunk* Chunk);
+	//Component of the region is released with the last member
+	void RemoveFromRegion(UVoxelChunk* Chunk, UVoxelRegionProvider* RegionProvider);
+
+	//Far from trackers and not edited lately, see bBatchChunks
+	bool ShouldBeBatched(UVoxelChunk* Chunk);
+
+	//Edited less than BatchEditCooldown ago
+	bool IsInBatchCooldown(UVoxelChunk* Chunk) const;
+
+	//Chunk is activated when its cooldown ends, call when a chunk not in cooldown is edited. Game thread only
+	void QueueBatchCooldown(UVoxelChunk* Chunk);
+
+	inline FIntVector GetRegionPos(const FIntVector& ChunkPos) const
+	{
+		return FIntVector(FMath::FloorToInt(float(ChunkPos.X) / RegionSize), FMath::FloorToInt(float(ChunkPos.Y) / RegionSize), FMath::FloorToInt(float(ChunkPos.Z) / RegionSize));
+	}
 
 	FVoxelMesher* GetMesher();
 
 	float GetMinDistanceToTrackers(const FIntVector& ChunkPos);
 
+	//Applies difference of interest of a tracker moved from OldChunkPos to NewChunkPos, either can be null
+	void MoveTrackerInterest(const FIntVector* OldChunkPos, const FIntVector* NewChunkPos);
+
+	void AddChunkInterest(const FIntVector& ChunkPos, const int InterestDelta, const int RenderDelta);
+
+	//Activates chunks a tracker moved into or out of UnbatchDistance of, either can be null
+	void ActivateUnbatchedChanges(const FIntVector* OldChunkPos, const FIntVector* NewChunkPos);
+
+	//Sends current tracker positions and view directions to the scheduler
+	void UpdateTrackerViews();
+
 	bool ShouldBeRendered(const FIntVector& Chunk);
 	bool ShouldBeDestroyed(const FIntVector& Chunk);
 
+	//Can do one more game thread update this frame? Measure it with FVoxelUpdateScope.
 	bool TryUpdate()
 	{
-		return UpdatesThisTick++ < MaxUpdatesPerTick;
+		//At least one per frame, so nothing starves on long frames
+		if (UpdatesThisTick > 0 && UpdateCyclesThisTick >= UpdateBudgetCycles)
+		{
+			return false;
+		}
+
+		UpdatesThisTick++;
+		return true;
+	}
+
+	void AddUpdateCycles(const uint64 Cycles)
+	{
+		UpdateCyclesThisTick += Cycles;
+	}
+
+	int GetNumLODs() const
+	{
+		return 1 + FMath::Min(LODDistances.Num(), VOX_MAXLODS - 1);
+	}
+
+	//Game thread, when a chunk mesh is uploaded
+	void AddVertexReuseStats(const int32 NumQuadCorners, const int32 NumVertices)
+	{
+		UploadedQuadCorners += NumQuadCorners;
+		UploadedVertices += NumVertices;
+
+		//Corners per vertex, 1 if nothing is shared
+		LastVertexReuseRatio = NumVertices ? static_cast<float>(NumQuadCorners) / NumVertices : 0.0f;
 	}
 
 	inline FIntVector ToVoxelPos(const FVector& Val)
@@ -8,3 +8,6 @@ DECLARE_LOG_CATEGORY_EXTERN(LogVoxel, Log, All)
 
 #define VOX_CHUNKSIZE 32
 #define VOX_ARRAYSIZE (VOX_CHUNKSIZE*VOX_CHUNKSIZE*VOX_CHUNKSIZE)
+
+//Full detail, then 2x, 4x, 8x downsampled
+#define VOX_MAXLODS 4